@@ -16,19 +16,47 @@ TEMPLATE = app
 
 CONFIG(release, debug|release):DEFINES += QT_NO_DEBUG_OUTPUT
 
+LIBS += -lz
+
 
 SOURCES += \
     ../../src/main.cpp \
+    ../../src/abusedetector.cpp \
+    ../../src/acceptor.cpp \
+    ../../src/adminserver.cpp \
     ../../src/client.cpp \
+    ../../src/clock.cpp \
+    ../../src/heartbeatreceiver.cpp \
+    ../../src/httpexport.cpp \
+    ../../src/loadmonitor.cpp \
     ../../src/server.cpp \
     ../../src/planet.cpp \
-    ../../src/settings.cpp
+    ../../src/prober.cpp \
+    ../../src/serverindex.cpp \
+    ../../src/settings.cpp \
+    ../../src/statshistory.cpp \
+    ../../src/trafficrecorder.cpp \
+    ../../src/transport.cpp
 
 HEADERS += \
+    ../../src/abusedetector.h \
+    ../../src/acceptor.h \
+    ../../src/adminserver.h \
     ../../src/client.h \
+    ../../src/clock.h \
+    ../../src/flightrecorder.h \
+    ../../src/heartbeatreceiver.h \
+    ../../src/httpexport.h \
+    ../../src/loadmonitor.h \
     ../../src/server.h \
     ../../src/planet.h \
-    ../../src/settings.h
+    ../../src/prober.h \
+    ../../src/serverindex.h \
+    ../../src/settings.h \
+    ../../src/statshistory.h \
+    ../../src/trace.h \
+    ../../src/trafficrecorder.h \
+    ../../src/transport.h
 
 RESOURCES += \
     ../../resources/resources.qrc
@@ -0,0 +1,33 @@
+#-------------------------------------------------
+#
+# Checks qt-nfk-planet's prober against local stand-in game servers
+#
+#-------------------------------------------------
+
+QT       += core network
+
+QT       -= gui
+
+TARGET = qt-nfk-probecheck
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += \
+    ../../tools/probecheck/main.cpp \
+    ../../tools/probecheck/responder.cpp \
+    ../../src/clock.cpp \
+    ../../src/prober.cpp \
+    ../../src/server.cpp \
+    ../../src/settings.cpp
+
+HEADERS += \
+    ../../tools/probecheck/responder.h \
+    ../../src/client.h \
+    ../../src/clock.h \
+    ../../src/flightrecorder.h \
+    ../../src/prober.h \
+    ../../src/server.h \
+    ../../src/settings.h
@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# Replays traffic captured by qt-nfk-planet
+#
+#-------------------------------------------------
+
+QT       += core network
+
+QT       -= gui
+
+TARGET = qt-nfk-replay
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += \
+    ../../tools/replay/acceptbench.cpp \
+    ../../tools/replay/main.cpp \
+    ../../tools/replay/pipelinebench.cpp \
+    ../../tools/replay/replayer.cpp
+
+HEADERS += \
+    ../../tools/replay/acceptbench.h \
+    ../../tools/replay/pipelinebench.h \
+    ../../tools/replay/replayer.h \
+    ../../src/trace.h
@@ -0,0 +1,64 @@
+#-------------------------------------------------
+#
+# Runs qt-nfk-planet in virtual time against simulated clients
+#
+#-------------------------------------------------
+
+QT       += core network
+
+QT       -= gui
+
+TARGET = qt-nfk-sim
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+LIBS += -lz
+
+
+SOURCES += \
+    ../../tools/sim/fakeconnection.cpp \
+    ../../tools/sim/main.cpp \
+    ../../tools/sim/simulation.cpp \
+    ../../src/abusedetector.cpp \
+    ../../src/acceptor.cpp \
+    ../../src/adminserver.cpp \
+    ../../src/client.cpp \
+    ../../src/clock.cpp \
+    ../../src/heartbeatreceiver.cpp \
+    ../../src/httpexport.cpp \
+    ../../src/loadmonitor.cpp \
+    ../../src/server.cpp \
+    ../../src/planet.cpp \
+    ../../src/prober.cpp \
+    ../../src/serverindex.cpp \
+    ../../src/settings.cpp \
+    ../../src/statshistory.cpp \
+    ../../src/trafficrecorder.cpp \
+    ../../src/transport.cpp
+
+HEADERS += \
+    ../../tools/sim/fakeconnection.h \
+    ../../tools/sim/simulation.h \
+    ../../src/abusedetector.h \
+    ../../src/acceptor.h \
+    ../../src/adminserver.h \
+    ../../src/client.h \
+    ../../src/clock.h \
+    ../../src/flightrecorder.h \
+    ../../src/heartbeatreceiver.h \
+    ../../src/httpexport.h \
+    ../../src/loadmonitor.h \
+    ../../src/server.h \
+    ../../src/planet.h \
+    ../../src/prober.h \
+    ../../src/serverindex.h \
+    ../../src/settings.h \
+    ../../src/statshistory.h \
+    ../../src/trace.h \
+    ../../src/trafficrecorder.h \
+    ../../src/transport.h
+
+RESOURCES += \
+    ../../resources/resources.qrc
@@ -0,0 +1,194 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "abusedetector.h"
+#include "clock.h"
+#include "settings.h"
+
+AbuseDetector::AbuseDetector(QObject *parent) : QObject(parent), settings(Settings::getInstance())
+{
+    depth = qBound(1, settings.getAbuseSketchDepth(), 8);
+
+    // round the width down to a power of two, so that a counter index is just the top bits of a hash
+    widthBits = 1;
+    while (widthBits < 24 && (1 << (widthBits + 1)) <= settings.getAbuseSketchWidth()) {
+        widthBits ++;
+    }
+
+    counters.fill(0, depth << widthBits);
+
+    // odd multipliers for multiply-shift hashing, one per row
+    static const quint64 SEEDS[] = {
+        Q_UINT64_C(0x9E3779B97F4A7C15), Q_UINT64_C(0xC2B2AE3D27D4EB4F), Q_UINT64_C(0x165667B19E3779F9), Q_UINT64_C(0xD6E8FEB86659FD93),
+        Q_UINT64_C(0xFF51AFD7ED558CCD), Q_UINT64_C(0xC4CEB9FE1A85EC53), Q_UINT64_C(0x27D4EB2F165667C5), Q_UINT64_C(0x94D049BB133111EB)
+    };
+    for (int i = 0; i < depth; i ++) {
+        seeds << SEEDS[i];
+    }
+
+    maxTopK = qMax(settings.getAbuseTopK(), 1);
+    topK.reserve(maxTopK);
+
+    int prefixLength = qBound(0, settings.getAbusePrefixLength(), 32);
+    prefixMask = prefixLength == 0 ? 0 : ~quint32(0) << (32 - prefixLength);
+
+    lastDecay = Clock::get()->currentMSecsSinceEpoch();
+}
+
+int AbuseDetector::index(int row, quint64 key) const
+{
+    return (row << widthBits) + int(((key + 1) * seeds[row]) >> (64 - widthBits));
+}
+
+quint32 AbuseDetector::add(quint64 key, quint32 points)
+{
+    // conservative update: raise only the counters that are below the new estimate
+    quint32 newEstimate = estimate(key) + points;
+
+    for (int row = 0; row < depth; row ++) {
+        quint32 &counter = counters[index(row, key)];
+        if (counter < newEstimate) {
+            counter = newEstimate;
+        }
+    }
+
+    updateTopK(key, newEstimate);
+
+    return newEstimate;
+}
+
+quint32 AbuseDetector::estimate(quint64 key) const
+{
+    quint32 result = counters[index(0, key)];
+    for (int row = 1; row < depth; row ++) {
+        result = qMin(result, counters[index(row, key)]);
+    }
+    return result;
+}
+
+void AbuseDetector::updateTopK(quint64 key, quint32 points)
+{
+    int smallest = -1;
+
+    for (int i = 0; i < topK.size(); i ++) {
+        if (topK[i].key == key) {
+            topK[i].points = points;
+            return;
+        }
+        if (smallest == -1 || topK[i].points < topK[smallest].points) {
+            smallest = i;
+        }
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.points = points;
+
+    if (topK.size() < maxTopK) {
+        topK << entry;
+    } else if (smallest != -1 && topK[smallest].points < points) {
+        topK[smallest] = entry;
+    }
+}
+
+bool AbuseDetector::addPenalty(quint32 ip, int points)
+{
+    if (!settings.getEnableAbuseDetector() || ip == 0 || points <= 0) {
+        return false;
+    }
+
+    decay();
+
+    add(prefixKey(ip), points);
+    quint32 ipPoints = add(ipKey(ip), points);
+
+    return ipPoints >= quint32(settings.getAbuseIpThreshold()) && ipPoints - points < quint32(settings.getAbuseIpThreshold());
+}
+
+bool AbuseDetector::isHotIp(quint32 ip)
+{
+    if (!settings.getEnableAbuseDetector() || ip == 0) {
+        return false;
+    }
+
+    decay();
+
+    return estimate(ipKey(ip)) >= quint32(settings.getAbuseIpThreshold());
+}
+
+bool AbuseDetector::isHotPrefix(quint32 ip)
+{
+    if (!settings.getEnableAbuseDetector() || ip == 0) {
+        return false;
+    }
+
+    decay();
+
+    return estimate(prefixKey(ip)) >= quint32(settings.getAbusePrefixThreshold());
+}
+
+QVector<AbuseDetector::HeavyHitter> AbuseDetector::getHeavyHitters()
+{
+    decay();
+
+    QVector<HeavyHitter> result;
+    result.reserve(topK.size());
+
+    for (int i = 0; i < topK.size(); i ++) {
+        HeavyHitter hitter;
+        hitter.address = quint32(topK[i].key);
+        hitter.isPrefix = (topK[i].key >> 32) != 0;
+        hitter.points = topK[i].points;
+        result << hitter;
+    }
+
+    return result;
+}
+
+void AbuseDetector::decay()
+{
+    qint64 period = qMax(settings.getAbuseDecayPeriodSeconds(), 1) * qint64(1000);
+    qint64 now = Clock::get()->currentMSecsSinceEpoch();
+    qint64 periods = (now - lastDecay) / period;
+
+    if (periods <= 0) {
+        return;
+    }
+
+    lastDecay += periods * period;
+
+    // halving once per each period that has passed, anything beyond 31 halvings is zero anyway
+    int shift = int(qMin(periods, qint64(32)));
+
+    for (int i = 0; i < counters.size(); i ++) {
+        counters[i] = shift >= 32 ? 0 : counters[i] >> shift;
+    }
+
+    // drop the entries that have faded away completely, so that new sources can take their place
+    for (int i = topK.size() - 1; i >= 0; i --) {
+        topK[i].points = shift >= 32 ? 0 : topK[i].points >> shift;
+        if (topK[i].points == 0) {
+            topK.remove(i);
+        }
+    }
+}
@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ABUSEDETECTOR_H
+#define ABUSEDETECTOR_H
+
+#include <QObject>
+#include <QVector>
+
+class Settings;
+
+// Tracks penalty points per source IP and per IP prefix across all connections in fixed memory.
+//
+// Points are counted in a count-min sketch, which never underestimates, and the sources with the
+// most points are kept in a small top-K list. All counters are halved every decay period, so old
+// activity fades away. The decay follows the Clock and is caught up on the next use rather than on a
+// timer, so a simulated clock gives the same results on every run. Only IPv4 sources are tracked.
+class AbuseDetector : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AbuseDetector(QObject *parent = 0);
+
+    struct HeavyHitter {
+        // IP address or the first address of a prefix
+        quint32 address;
+        bool isPrefix;
+        quint32 points;
+    };
+
+    // returns true if the IP has become hot with these points
+    bool addPenalty(quint32 ip, int points);
+
+    bool isHotIp(quint32 ip);
+    bool isHotPrefix(quint32 ip);
+
+    QVector<HeavyHitter> getHeavyHitters();
+
+private:
+    struct Entry {
+        quint64 key;
+        quint32 points;
+    };
+
+    // number of hash functions and counters per each of them
+    int depth;
+    int widthBits;
+    // depth rows of 2^widthBits counters
+    QVector<quint32> counters;
+    QVector<quint64> seeds;
+    QVector<Entry> topK;
+    int maxTopK;
+
+    quint32 prefixMask;
+
+    // time of the last decay in msecs since epoch, as reported by the Clock
+    qint64 lastDecay;
+
+    Settings &settings;
+
+    static quint64 ipKey(quint32 ip) {return ip;}
+    quint64 prefixKey(quint32 ip) const {return (quint64(1) << 32) | (ip & prefixMask);}
+
+    inline int index(int row, quint64 key) const;
+    quint32 add(quint64 key, quint32 points);
+    quint32 estimate(quint64 key) const;
+    void updateTopK(quint64 key, quint32 points);
+    void decay();
+
+};
+
+#endif // ABUSEDETECTOR_H
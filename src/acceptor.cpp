@@ -0,0 +1,220 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "acceptor.h"
+#include "planet.h"
+#include "settings.h"
+
+#include <QSocketNotifier>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+Acceptor::Acceptor(Planet *planet) : QTcpServer(planet), planet(planet), acceptedCount(0), rejectedCount(0), listenFd(-1), notifier(NULL)
+{
+    batchSize = qMax(Settings::getInstance().getAcceptBatchSize(), 1);
+}
+
+Acceptor::~Acceptor()
+{
+#ifdef Q_OS_UNIX
+    if (listenFd != -1) {
+        delete notifier;
+        ::close(listenFd);
+    }
+#endif
+}
+
+bool Acceptor::listen(const QHostAddress &address, quint16 port, int backlog)
+{
+    errorString.clear();
+
+#ifdef Q_OS_UNIX
+    // QTcpServer always listens with a backlog of 50 and doesn't limit how many connections it
+    // accepts per wakeup, so the listening socket is ours from start to end
+    sockaddr_storage storage;
+    memset(&storage, 0, sizeof(storage));
+    socklen_t length;
+
+    if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+        sockaddr_in6 *address6 = reinterpret_cast<sockaddr_in6*>(&storage);
+        address6->sin6_family = AF_INET6;
+        address6->sin6_port = htons(port);
+        Q_IPV6ADDR ip = address.toIPv6Address();
+        memcpy(&address6->sin6_addr, &ip, sizeof(ip));
+        length = sizeof(sockaddr_in6);
+    } else {
+        sockaddr_in *address4 = reinterpret_cast<sockaddr_in*>(&storage);
+        address4->sin_family = AF_INET;
+        address4->sin_port = htons(port);
+        address4->sin_addr.s_addr = htonl(address.toIPv4Address());
+        length = sizeof(sockaddr_in);
+    }
+
+    int fd = ::socket(storage.ss_family, SOCK_STREAM, 0);
+    if (fd == -1) {
+        errorString = QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    int reuse = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&storage), length) != 0 || ::listen(fd, backlog) != 0) {
+        errorString = QString::fromLocal8Bit(strerror(errno));
+        ::close(fd);
+        return false;
+    }
+
+    listenFd = fd;
+    notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(notifier, SIGNAL(activated(int)), this, SLOT(onAcceptReady()));
+
+    return true;
+#else
+    Q_UNUSED(backlog);
+    return QTcpServer::listen(address, port);
+#endif
+}
+
+void Acceptor::onAcceptReady()
+{
+#ifdef Q_OS_UNIX
+    int handled = 0;
+    bool added = false;
+
+    while (handled < batchSize) {
+        sockaddr_storage storage;
+        socklen_t length = sizeof(storage);
+#ifdef Q_OS_LINUX
+        int fd = ::accept4(listenFd, reinterpret_cast<sockaddr*>(&storage), &length, SOCK_CLOEXEC | SOCK_NONBLOCK);
+#else
+        int fd = ::accept(listenFd, reinterpret_cast<sockaddr*>(&storage), &length);
+        if (fd != -1) {
+            ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+            ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+#endif
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                qWarning("Failed to accept a connection. %s.", strerror(errno));
+                notifier->setEnabled(false);
+                QTimer::singleShot(ACCEPT_ERROR_DELAY, this, SLOT(onResumeAccepting()));
+            }
+            break;
+        }
+
+        // rejected connections take their share of the batch too, they are what a storm is made of
+        handled ++;
+
+        QHostAddress address;
+        address.setAddress(reinterpret_cast<sockaddr*>(&storage));
+        if (addConnection(fd, address)) {
+            added = true;
+        }
+    }
+
+    if (handled == batchSize) {
+        // there may be more waiting, they get their turn after everything else that is ready
+        notifier->setEnabled(false);
+        QTimer::singleShot(0, this, SLOT(onResumeAccepting()));
+    }
+
+    if (added) {
+        emit newConnection();
+    }
+#endif
+}
+
+void Acceptor::onResumeAccepting()
+{
+    if (notifier != NULL) {
+        notifier->setEnabled(true);
+    }
+}
+
+bool Acceptor::addConnection(SocketDescriptor socketDescriptor, const QHostAddress &address)
+{
+#ifdef Q_OS_UNIX
+    if (!planet->admitConnection(address)) {
+        ::close(socketDescriptor);
+        rejectedCount ++;
+        return false;
+    }
+
+    QTcpSocket *socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        qWarning("Failed to set up an accepted connection. %s.", qPrintable(socket->errorString()));
+        delete socket;
+        // the socket hasn't taken the descriptor over, and the connection has already been counted
+        ::close(socketDescriptor);
+        planet->withdrawAdmission(address);
+        return false;
+    }
+
+    acceptedCount ++;
+    addPendingConnection(socket);
+    return true;
+#else
+    Q_UNUSED(socketDescriptor);
+    Q_UNUSED(address);
+    return false;
+#endif
+}
+
+void Acceptor::incomingConnection(SocketDescriptor socketDescriptor)
+{
+    // only called where QTcpServer does the accepting. there is no portable way of getting the peer
+    // address of a bare descriptor, so check it on the socket instead
+    QTcpSocket *socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        qWarning("Failed to set up an accepted connection. %s.", qPrintable(socket->errorString()));
+        delete socket;
+        return;
+    }
+
+    if (!planet->admitConnection(socket->peerAddress())) {
+        socket->abort();
+        delete socket;
+        rejectedCount ++;
+        return;
+    }
+
+    acceptedCount ++;
+    addPendingConnection(socket);
+}
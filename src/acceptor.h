@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ACCEPTOR_H
+#define ACCEPTOR_H
+
+#include <QTcpServer>
+
+class Planet;
+class QSocketNotifier;
+
+#if QT_VERSION >= 0x050000
+typedef qintptr SocketDescriptor;
+#else
+typedef int SocketDescriptor;
+#endif
+
+// Listening socket of the planet.
+//
+// On Unix the listening socket is created and accepted on here rather than by QTcpServer, which
+// always listens with a backlog of 50 and accepts until the queue would block, however many
+// connections are waiting. Here at most acceptBatchSize connections are accepted per wakeup,
+// rejected ones included, before the rest of the event loop gets its turn. Connections are
+// accepted with accept4() and SOCK_CLOEXEC | SOCK_NONBLOCK on Linux. The planet is asked whether
+// it wants a connection right after it was accepted, with nothing but the raw peer address, so
+// that unwanted connections get closed before any QTcpSocket or Client is created for them.
+//
+// Elsewhere QTcpServer does the listening and accepting, and connections are checked on the socket.
+class Acceptor : public QTcpServer
+{
+    Q_OBJECT
+public:
+    explicit Acceptor(Planet *planet);
+    ~Acceptor();
+
+    bool listen(const QHostAddress &address, quint16 port, int backlog);
+
+    // error of the last failed listen(), QTcpServer doesn't let us set its own
+    QString getErrorString() {return errorString.isEmpty() ? QTcpServer::errorString() : errorString;}
+
+    quint64 getAcceptedCount() {return acceptedCount;}
+    quint64 getRejectedCount() {return rejectedCount;}
+
+protected:
+    void incomingConnection(SocketDescriptor socketDescriptor);
+
+private:
+    Planet *planet;
+    QString errorString;
+    int batchSize;
+
+    quint64 acceptedCount;
+    quint64 rejectedCount;
+
+    // listening socket and its notifier, -1 and NULL when QTcpServer listens by itself
+    int listenFd;
+    QSocketNotifier *notifier;
+
+    // how long to stop accepting after an error such as running out of descriptors, the listening
+    // socket stays readable so it would be retried in a busy loop otherwise
+    static const int ACCEPT_ERROR_DELAY = 1000;
+
+    // hands an accepted connection over to the planet, returns false if it was closed instead
+    bool addConnection(SocketDescriptor socketDescriptor, const QHostAddress &address);
+
+private slots:
+    void onAcceptReady();
+    void onResumeAccepting();
+
+};
+
+#endif // ACCEPTOR_H
@@ -0,0 +1,522 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "abusedetector.h"
+#include "adminserver.h"
+#include "client.h"
+#include "loadmonitor.h"
+#include "planet.h"
+#include "server.h"
+#include "statshistory.h"
+#include "transport.h"
+
+#include <QDateTime>
+#include <QHostAddress>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QStringList>
+#include <QTcpSocket>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+AdminServer::AdminServer(Planet *planet) : QObject(planet), planet(planet), settings(Settings::getInstance())
+{
+    server = new QLocalServer(this);
+    connect(server, SIGNAL(newConnection()), this, SLOT(onConnection()));
+}
+
+bool AdminServer::start(const QString &name)
+{
+    // a socket file left over after a crash would prevent us from listening
+    QLocalServer::removeServer(name);
+
+    // only the user running the planet may use the socket. the socket file gets its permissions
+    // from the umask when it's created, so there is no moment when others could connect
+#ifdef Q_OS_UNIX
+    mode_t oldUmask = ::umask(0077);
+#endif
+    bool listening = server->listen(name);
+#ifdef Q_OS_UNIX
+    ::umask(oldUmask);
+#endif
+
+    if (!listening) {
+        qWarning("Failed to start admin server on %s. %s.", qPrintable(name), qPrintable(server->errorString()));
+        return false;
+    }
+
+    qDebug("Admin server is listening on %s.", qPrintable(server->fullServerName()));
+    return true;
+}
+
+QByteArray AdminServer::jsonString(const QString &string)
+{
+    QByteArray result;
+    result.reserve(string.size() + 2);
+    result.append('"');
+
+    QByteArray utf8 = string.toUtf8();
+    for (int i = 0; i < utf8.size(); i ++) {
+        char c = utf8[i];
+        switch (c) {
+            case '"':
+                result.append("\\\"");
+                break;
+            case '\\':
+                result.append("\\\\");
+                break;
+            case '\n':
+                result.append("\\n");
+                break;
+            case '\r':
+                result.append("\\r");
+                break;
+            case '\t':
+                result.append("\\t");
+                break;
+            default:
+                if (static_cast<uchar>(c) < 0x20) {
+                    result.append(QString("\\u%1").arg(static_cast<uchar>(c), 4, 16, QChar('0')).toAscii());
+                } else {
+                    result.append(c);
+                }
+                break;
+        }
+    }
+
+    result.append('"');
+    return result;
+}
+
+// JSON is put together by appending, never with QString::arg(), which would substitute
+// any %N that ends up in a client supplied string inserted by an earlier arg()
+QByteArray AdminServer::toJson(const ClientRow &row)
+{
+    QByteArray json;
+    json.append("{\"id\":").append(QByteArray::number(row.id));
+    json.append(",\"address\":").append(jsonString(row.address));
+    json.append(",\"port\":").append(QByteArray::number(row.port));
+    json.append(",\"version\":").append(QByteArray::number(row.version));
+    json.append(",\"penaltyPoints\":").append(QByteArray::number(row.penaltyPoints));
+    json.append(",\"lastPinged\":").append(QByteArray::number(row.lastPinged));
+    json.append(",\"pendingOutput\":").append(QByteArray::number(row.pendingOutput));
+    json.append(",\"serverId\":").append(row.serverId == 0 ? QByteArray("null") : QByteArray::number(row.serverId));
+    json.append("}\n");
+    return json;
+}
+
+QByteArray AdminServer::toJson(const ServerRow &row)
+{
+    QByteArray json;
+    json.append("{\"id\":").append(QByteArray::number(row.id));
+    json.append(",\"address\":").append(jsonString(row.address));
+    json.append(",\"port\":").append(QByteArray::number(row.port));
+    json.append(",\"hostname\":").append(jsonString(row.hostname));
+    json.append(",\"mapname\":").append(jsonString(row.mapname));
+    json.append(",\"gametype\":").append(jsonString(row.gametype));
+    json.append(",\"currentUsers\":").append(jsonString(QString(QChar(row.currentUsers))));
+    json.append(",\"maxUsers\":").append(jsonString(QString(QChar(row.maxUsers))));
+    json.append(",\"latency\":").append(QByteArray::number(row.latency));
+    json.append(",\"hidden\":").append(row.hidden ? "true" : "false");
+    json.append("}\n");
+    return json;
+}
+
+void AdminServer::onConnection()
+{
+    while (server->hasPendingConnections()) {
+        Connection *connection = new Connection();
+        connection->socket = server->nextPendingConnection();
+        connection->position = 0;
+
+        connect(connection->socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(connection->socket, SIGNAL(bytesWritten(qint64)), this, SLOT(onBytesWritten()));
+        connect(connection->socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+
+        connections.insert(connection->socket, connection);
+    }
+}
+
+void AdminServer::onDisconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(sender());
+    delete connections.take(socket);
+    socket->deleteLater();
+}
+
+void AdminServer::onReadyRead()
+{
+    Connection *connection = connections.value(qobject_cast<QLocalSocket*>(sender()));
+    if (connection != NULL) {
+        processInput(connection);
+    }
+}
+
+void AdminServer::onBytesWritten()
+{
+    Connection *connection = connections.value(qobject_cast<QLocalSocket*>(sender()));
+    if (connection == NULL) {
+        return;
+    }
+
+    if (isStreaming(connection)) {
+        streamMore(connection);
+    } else {
+        // commands that came while we were streaming have been waiting for it to finish
+        processInput(connection);
+    }
+}
+
+void AdminServer::processInput(Connection *connection)
+{
+    while (!isStreaming(connection) && connection->socket->canReadLine()) {
+        QString line = QString::fromUtf8(connection->socket->readLine()).trimmed();
+        if (!line.isEmpty()) {
+            handleCommand(connection, line);
+        }
+    }
+}
+
+void AdminServer::reply(Connection *connection, const QByteArray &json)
+{
+    connection->socket->write(json);
+    connection->socket->write("\n", 1);
+}
+
+void AdminServer::replyError(Connection *connection, const QString &error)
+{
+    reply(connection, "{\"error\":" + jsonString(error) + "}");
+}
+
+Client *AdminServer::findClient(const QString &id)
+{
+    bool ok;
+    quint32 clientId = id.toUInt(&ok);
+    if (!ok) {
+        return NULL;
+    }
+
+    const QList<Client*> &clients = planet->getClients();
+    for (int i = 0; i < clients.size(); i ++) {
+        if (clients[i]->id == clientId) {
+            return clients[i];
+        }
+    }
+
+    return NULL;
+}
+
+void AdminServer::handleCommand(Connection *connection, const QString &line)
+{
+    QStringList args = line.split(' ', QString::SkipEmptyParts);
+    QString command = args.takeFirst();
+
+    if (command == "clients" && args.isEmpty()) {
+        // take a shallow snapshot now, it's turned into JSON later, a chunk at a time
+        connection->position = 0;
+        const QList<Client*> &clients = planet->getClients();
+        for (int i = 0; i < clients.size(); i ++) {
+            Client *client = clients[i];
+            ClientRow row;
+            row.id = client->id;
+            row.address = client->sock->peerAddress().toString();
+            row.port = client->sock->peerPort();
+            row.version = client->version;
+            row.penaltyPoints = client->getPenaltyPoints();
+            row.lastPinged = client->lastPinged;
+            row.pendingOutput = client->sock->bytesToWrite();
+            row.serverId = client->server == NULL ? 0 : client->server->id;
+            connection->clients << row;
+        }
+        streamMore(connection);
+    } else if (command == "servers" && args.isEmpty()) {
+        connection->position = 0;
+        const QList<Server*> &servers = planet->getServers();
+        for (int i = 0; i < servers.size(); i ++) {
+            Server *server = servers[i];
+            ServerRow row;
+            row.id = server->id;
+            row.address = server->getIp();
+            row.port = server->port;
+            row.hostname = server->getHostname();
+            row.mapname = server->getMapname();
+            row.gametype = server->getGametypeString();
+            row.currentUsers = server->currentUsers;
+            row.maxUsers = server->maxUsers;
+            row.latency = server->latency;
+            row.hidden = server->hidden;
+            connection->servers << row;
+        }
+        streamMore(connection);
+    } else if (command == "client" && args.size() == 1) {
+        Client *client = findClient(args[0]);
+        if (client == NULL) {
+            replyError(connection, "no such client");
+            return;
+        }
+        replyClient(connection, client);
+    } else if (command == "kick" && args.size() == 1) {
+        Client *client = findClient(args[0]);
+        if (client == NULL) {
+            replyError(connection, "no such client");
+            return;
+        }
+        qWarning("Kicking client %s:%u on admin's request.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+        planet->disconnectClient(client);
+        reply(connection, "{\"ok\":true}");
+    } else if (command == "ban" && args.size() == 1) {
+        QHostAddress address;
+        if (!address.setAddress(args[0])) {
+            replyError(connection, "invalid IP address");
+            return;
+        }
+        qWarning("Blacklisting IP %s on admin's request.", qPrintable(address.toString()));
+        planet->banIp(address);
+        reply(connection, "{\"ok\":true}");
+    } else if (command == "unban" && args.size() == 1) {
+        QHostAddress address;
+        if (!address.setAddress(args[0])) {
+            replyError(connection, "invalid IP address");
+            return;
+        }
+        if (!settings.unblacklistIp(address.toString())) {
+            replyError(connection, "IP is not blacklisted");
+            return;
+        }
+        qWarning("Removed IP %s from the blacklist on admin's request.", qPrintable(address.toString()));
+        reply(connection, "{\"ok\":true}");
+    } else if (command == "stats" && args.isEmpty()) {
+        replyStats(connection);
+    } else if (command == "history" && args.size() >= 1 && args.size() <= 3) {
+        replyHistory(connection, args);
+    } else if (command == "dump" && args.size() <= 1) {
+        Client *client = NULL;
+        if (args.size() == 1 && (client = findClient(args[0])) == NULL) {
+            replyError(connection, "no such client");
+            return;
+        }
+        QString filePath = QString("flightrecorder-%1.log").arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+        if (!planet->dumpFlightRecorder(filePath, client)) {
+            replyError(connection, "failed to write " + filePath);
+            return;
+        }
+        reply(connection, "{\"file\":" + jsonString(filePath) + "}");
+    } else {
+        replyError(connection, "unknown command or wrong number of arguments: " + line);
+    }
+}
+
+void AdminServer::streamMore(Connection *connection)
+{
+    if (connection->socket->bytesToWrite() > MAX_PENDING_OUTPUT) {
+        // we will be called again once some of it is written
+        return;
+    }
+
+    QByteArray chunk;
+    int total = connection->clients.size() + connection->servers.size();
+    int end = qMin(connection->position + CHUNK_ROWS, total);
+
+    for (; connection->position < end; connection->position ++) {
+        if (!connection->clients.isEmpty()) {
+            chunk.append(toJson(connection->clients[connection->position]));
+        } else {
+            chunk.append(toJson(connection->servers[connection->position]));
+        }
+    }
+
+    if (connection->position == total) {
+        chunk.append(QString("{\"end\":true,\"count\":%1}\n").arg(total).toAscii());
+        connection->clients.clear();
+        connection->servers.clear();
+        connection->position = 0;
+    }
+
+    // the rest follows from onBytesWritten()
+    connection->socket->write(chunk);
+}
+
+void AdminServer::replyClient(Connection *connection, Client *client)
+{
+    QByteArray json;
+    json.append("{\"id\":").append(QByteArray::number(client->id));
+    json.append(",\"address\":").append(jsonString(client->sock->peerAddress().toString()));
+    json.append(",\"port\":").append(QByteArray::number(client->sock->peerPort()));
+    json.append(",\"version\":").append(QByteArray::number(client->version));
+    json.append(",\"extensions\":").append(QByteArray::number(client->extensions));
+    json.append(",\"penaltyPoints\":").append(QByteArray::number(client->getPenaltyPoints()));
+    json.append(",\"penaltyLimitReached\":").append(client->getPenaltyPoints() >= settings.getMaxPenaltyPoints() ? "true" : "false");
+    json.append(",\"lastPinged\":").append(QByteArray::number(client->lastPinged));
+    json.append(",\"pendingOutput\":").append(QByteArray::number(client->sock->bytesToWrite()));
+    json.append(",\"serverListPending\":").append(client->serverListPending || client->filteredServerListPending ? "true" : "false");
+    json.append(",\"serverId\":").append(client->server == NULL ? QByteArray("null") : QByteArray::number(client->server->id));
+    json.append(",\"events\":[");
+
+    for (int i = 0; i < client->events.size(); i ++) {
+        const FlightRecorder::Event &event = client->events.at(i);
+        if (i != 0) {
+            json.append(',');
+        }
+        json.append("{\"time\":").append(QByteArray::number(event.time));
+        json.append(",\"command\":").append(jsonString(event.command ? QString(QChar(event.command)) : QString()));
+        json.append(",\"length\":").append(QByteArray::number(event.length));
+        json.append(",\"replySize\":").append(QByteArray::number(event.replySize));
+        json.append(",\"penaltyPoints\":").append(QByteArray::number(event.penaltyPoints));
+        json.append('}');
+    }
+
+    json.append("]}");
+    reply(connection, json);
+}
+
+void AdminServer::replyStats(Connection *connection)
+{
+    Planet::Stats planetStats;
+    planet->getStats(planetStats);
+
+    QByteArray json;
+    json.append("{\"uptime\":").append(QByteArray::number(planetStats.uptime));
+    json.append(",\"clients\":").append(QByteArray::number(planetStats.clients));
+    json.append(",\"servers\":").append(QByteArray::number(planetStats.servers));
+    json.append(",\"registryVersion\":").append(QByteArray::number(planetStats.registryVersion));
+    json.append(",\"blacklistedIps\":").append(QByteArray::number(settings.getBlacklistedIps().size()));
+    json.append(",\"commands\":{");
+
+    for (int i = 0; i < Planet::getCommandCount(); i ++) {
+        const Planet::CommandStats &stats = planet->getCommandStats(i);
+        if (i != 0) {
+            json.append(',');
+        }
+        json.append(jsonString(QString(QChar(Planet::getCommand(i)))));
+        json.append(":{\"count\":").append(QByteArray::number(stats.count));
+        json.append(",\"penaltyPoints\":").append(QByteArray::number(stats.penaltyPoints));
+        json.append(",\"replyBytes\":").append(QByteArray::number(stats.replyBytes));
+        json.append('}');
+    }
+
+    json.append("},\"heavyHitters\":[");
+
+    QVector<AbuseDetector::HeavyHitter> hitters = planet->getAbuseDetector()->getHeavyHitters();
+    for (int i = 0; i < hitters.size(); i ++) {
+        if (i != 0) {
+            json.append(',');
+        }
+        json.append("{\"address\":").append(jsonString(QHostAddress(hitters[i].address).toString()));
+        json.append(",\"prefix\":").append(hitters[i].isPrefix ? "true" : "false");
+        json.append(",\"points\":").append(QByteArray::number(hitters[i].points));
+        json.append('}');
+    }
+
+    json.append("],\"heartbeat\":{\"servers\":").append(QByteArray::number(planetStats.heartbeatServers));
+    json.append(",\"received\":").append(QByteArray::number(planet->getHeartbeatReceiver()->getReceivedCount()));
+    json.append(",\"rejected\":").append(QByteArray::number(planet->getHeartbeatReceiver()->getRejectedCount()));
+    json.append('}');
+
+    // ratio of what the sent lists would have taken uncompressed to what they took
+    quint64 rawBytes = planetStats.compressedServerListRawBytes;
+    quint64 compressedBytes = planetStats.compressedServerListBytes;
+    json.append(",\"compression\":{\"sent\":").append(QByteArray::number(planetStats.compressedServerListsSent));
+    json.append(",\"rawBytes\":").append(QByteArray::number(rawBytes));
+    json.append(",\"compressedBytes\":").append(QByteArray::number(compressedBytes));
+    json.append(",\"bytesSaved\":").append(QByteArray::number(rawBytes > compressedBytes ? rawBytes - compressedBytes : 0));
+    json.append(",\"ratio\":").append(QByteArray::number(compressedBytes != 0 ? static_cast<double>(rawBytes) / compressedBytes : 0.0, 'f', 2));
+    json.append('}');
+
+    LoadMonitor *loadMonitor = planet->getLoadMonitor();
+    json.append(",\"load\":{\"level\":").append(jsonString(LoadMonitor::getLevelName(loadMonitor->getLevel())));
+    json.append(",\"lag\":").append(QByteArray::number(loadMonitor->getLag()));
+    json.append(",\"maxLag\":").append(QByteArray::number(loadMonitor->getMaxLag()));
+    json.append(",\"overloadRejections\":").append(QByteArray::number(planetStats.overloadRejections));
+    json.append(",\"levels\":{");
+
+    for (int i = 0; i < LoadMonitor::LevelCount; i ++) {
+        if (i != 0) {
+            json.append(',');
+        }
+        json.append(jsonString(LoadMonitor::getLevelName(i)));
+        json.append(":{\"transitions\":").append(QByteArray::number(loadMonitor->getTransitions(i)));
+        json.append(",\"time\":").append(QByteArray::number(loadMonitor->getTimeInLevel(i)));
+        json.append('}');
+    }
+
+    json.append("}}}");
+    reply(connection, json);
+}
+
+void AdminServer::replyHistory(Connection *connection, const QStringList &args)
+{
+    StatsHistory *history = planet->getStatsHistory();
+    if (!history->isStarted()) {
+        replyError(connection, "history is not being recorded");
+        return;
+    }
+
+    int tier = 0;
+    while (tier < StatsHistory::TierCount && args[0] != StatsHistory::getTierName(tier)) {
+        tier ++;
+    }
+    if (tier == StatsHistory::TierCount) {
+        replyError(connection, "unknown tier: " + args[0]);
+        return;
+    }
+
+    bool fromOk = true;
+    bool toOk = true;
+    qint64 to = args.size() >= 3 ? args[2].toLongLong(&toOk) : QDateTime::currentMSecsSinceEpoch() / 1000;
+    qint64 from = args.size() >= 2 ? args[1].toLongLong(&fromOk) : to - qint64(StatsHistory::getTierCapacity(tier)) * StatsHistory::getTierPeriod(tier);
+    if (!fromOk || !toOk) {
+        replyError(connection, "invalid time");
+        return;
+    }
+
+    QVector<StatsHistory::Sample> samples = history->query(tier, from, to);
+    QByteArray commands = history->getCommands();
+
+    // samples are arrays rather than objects, there can be thousands of them
+    QByteArray json;
+    json.append("{\"tier\":").append(jsonString(StatsHistory::getTierName(tier)));
+    json.append(",\"period\":").append(QByteArray::number(StatsHistory::getTierPeriod(tier)));
+    json.append(",\"fields\":[\"time\",\"servers\",\"players\",\"clients\",\"commands\"]");
+    json.append(",\"commands\":").append(jsonString(QString::fromLatin1(commands)));
+    json.append(",\"samples\":[");
+
+    for (int i = 0; i < samples.size(); i ++) {
+        const StatsHistory::Sample &sample = samples[i];
+        if (i != 0) {
+            json.append(',');
+        }
+        json.append(QString("[%1,%2,%3,%4,[").arg(sample.time).arg(sample.servers).arg(sample.players).arg(sample.clients).toAscii());
+        for (int j = 0; j < commands.size(); j ++) {
+            if (j != 0) {
+                json.append(',');
+            }
+            json.append(QByteArray::number(sample.commands[j]));
+        }
+        json.append("]]");
+    }
+
+    json.append("]}");
+    reply(connection, json);
+}
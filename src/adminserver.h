@@ -0,0 +1,137 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ADMINSERVER_H
+#define ADMINSERVER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+class Client;
+class Planet;
+class QLocalServer;
+class QLocalSocket;
+class Settings;
+
+// Local control socket for looking into and managing a running planet.
+//
+// Takes one command per line and replies with one JSON object per line:
+//   clients               all connected clients, followed by {"end":true,"count":N}
+//   servers               all registered servers, followed by {"end":true,"count":N}
+//   client <id>           penalty state and last protocol events of a client
+//   kick <id>             disconnect a client
+//   ban <ip>              blacklist an IP and disconnect all of its clients
+//   unban <ip>            remove an IP from the blacklist
+//   stats                 planet-wide counters
+//   dump [<id>]           dump the flight recorder of all clients, or of a single one, into a file
+//   history <tier> [<from> [<to>]]
+//                         recorded statistics of a tier (second, minute or hour) between two times in
+//                         seconds since epoch, everything the tier holds by default
+// Errors are reported as {"error":"..."}.
+//
+// Listings are taken as a snapshot first and then turned into JSON and sent a chunk at a time,
+// so that a big listing or a slow reader doesn't hold up the planet.
+class AdminServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AdminServer(Planet *planet);
+
+    bool start(const QString &name);
+
+    static QByteArray jsonString(const QString &string);
+
+private:
+    struct ClientRow {
+        quint32 id;
+        QString address;
+        quint16 port;
+        int version;
+        int penaltyPoints;
+        qint64 lastPinged;
+        qint64 pendingOutput;
+        // 0 if the client has no server registered
+        quint32 serverId;
+    };
+
+    struct ServerRow {
+        quint32 id;
+        QString address;
+        quint16 port;
+        QString hostname;
+        QString mapname;
+        QString gametype;
+        char currentUsers;
+        char maxUsers;
+        int latency;
+        bool hidden;
+    };
+
+    struct Connection {
+        QLocalSocket *socket;
+        // snapshot being streamed, only one of them is non-empty at a time
+        QList<ClientRow> clients;
+        QList<ServerRow> servers;
+        int position;
+    };
+
+    Planet *planet;
+    QLocalServer *server;
+    QHash<QLocalSocket*, Connection*> connections;
+
+    Settings &settings;
+
+    // rows turned into JSON per event loop iteration
+    static const int CHUNK_ROWS = 256;
+    // don't produce more output while this much of it is still waiting to be sent
+    static const int MAX_PENDING_OUTPUT = 64*1024;
+
+    void processInput(Connection *connection);
+    void handleCommand(Connection *connection, const QString &line);
+    void streamMore(Connection *connection);
+    bool isStreaming(Connection *connection) {return connection->position < connection->clients.size() + connection->servers.size();}
+
+    Client *findClient(const QString &id);
+
+    void reply(Connection *connection, const QByteArray &json);
+    void replyError(Connection *connection, const QString &error);
+    void replyClient(Connection *connection, Client *client);
+    void replyStats(Connection *connection);
+    void replyHistory(Connection *connection, const QStringList &args);
+
+    static QByteArray toJson(const ClientRow &row);
+    static QByteArray toJson(const ServerRow &row);
+
+private slots:
+    void onConnection();
+    void onReadyRead();
+    void onBytesWritten();
+    void onDisconnected();
+
+};
+
+#endif // ADMINSERVER_H
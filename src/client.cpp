@@ -22,10 +22,16 @@
  */
 
 #include "client.h"
+#include "clock.h"
 #include "settings.h"
 
 #include <QDateTime>
 
+Client::Client() : penaltyPoints(0)
+{
+    // intentially left blank
+}
+
 Client::Penalty::Penalty(quint64 time, int value) : time(time), value(value)
 {
     // intentially left blank
@@ -33,7 +39,7 @@ Client::Penalty::Penalty(quint64 time, int value) : time(time), value(value)
 
 void Client::addPenalty(int value)
 {
-    penaltyQueue.enqueue(Penalty(QDateTime::currentMSecsSinceEpoch(), value));
+    penaltyQueue.enqueue(Penalty(Clock::get()->currentMSecsSinceEpoch(), value));
     penaltyPoints += value;
     qDebug("Adding penalty of %d.", value);
     qDebug("%d Total penalty points %d.", QTime::currentTime().second(), penaltyPoints);
@@ -42,7 +48,7 @@ void Client::addPenalty(int value)
 bool Client::isPenaltyLimitReached()
 {
     // get onle points that are within last penaltyPeriod seconds
-    quint64 currentTime = QDateTime::currentMSecsSinceEpoch();
+    quint64 currentTime = Clock::get()->currentMSecsSinceEpoch();
 
     Settings &settings = Settings::getInstance();
 
@@ -24,23 +24,56 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+#include "flightrecorder.h"
+
+#include <QByteArray>
 #include <QMetaType>
 #include <QtGlobal>
 #include <QQueue>
 
-class QTcpSocket;
 class Server;
+class Transport;
 
 class Client
 {
 public:
-    QTcpSocket *sock;
+    // protocol extensions a client can ask for in its version request
+    enum Extension {
+        FilteredServerListExtension = 1 << 0,
+        HeartbeatExtension = 1 << 1,
+        CompressedServerListExtension = 1 << 2
+    };
+
+    Client();
+
+    Transport *sock;
+    // unique for the lifetime of the planet
+    quint32 id;
+    // peer address, 0 if it's not an IPv4 one
+    quint32 ipv4;
     int version;
+    // Extension flags negotiated with the client
+    int extensions;
     qint64 lastPinged;
     Server *server;
+    // client asked for the server list while it still had too much unsent output
+    bool serverListPending;
+    // the pending server list is to be sent compressed
+    bool compressedServerListPending;
+    // client asked for a filtered server list while it still had too much unsent output, the last filter wins
+    bool filteredServerListPending;
+    QByteArray pendingServerListFilter;
+    // time since when client's output is over the limit, 0 if it's not
+    qint64 overLimitSince;
+    // client is in Planet's ready queue, waiting for its next turn to have its input processed
+    bool readyQueued;
+
+    // last protocol events of this client
+    FlightRecorder::Ring<32> events;
 
     void addPenalty(int value);
     bool isPenaltyLimitReached();
+    int getPenaltyPoints() {return penaltyPoints;}
 
 private:
     struct Penalty {
@@ -0,0 +1,56 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <QtGlobal>
+
+// Source of the current time for everything that measures timeouts and rates.
+//
+// It's the system clock unless something else has been installed, which the simulator does to
+// run the planet in virtual time.
+class Clock
+{
+public:
+    virtual ~Clock() {}
+
+    virtual qint64 currentMSecsSinceEpoch() = 0;
+
+    static Clock *get() {return instance;}
+    // doesn't take the ownership, NULL restores the system clock
+    static void set(Clock *clock);
+
+private:
+    static Clock *instance;
+
+};
+
+class SystemClock : public Clock
+{
+public:
+    qint64 currentMSecsSinceEpoch();
+
+};
+
+#endif // CLOCK_H
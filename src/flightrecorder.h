@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FLIGHTRECORDER_H
+#define FLIGHTRECORDER_H
+
+#include <QtGlobal>
+
+// Fixed-size ring of the last protocol events. Everything is preallocated,
+// recording an event is a couple of stores, so it can be left on all the time.
+namespace FlightRecorder {
+
+struct Event {
+    // milliseconds since the planet has started
+    qint64 time;
+    quint32 clientId;
+    // bytes queued for sending while handling the command
+    quint32 replySize;
+    // client's penalty points after handling the command
+    qint32 penaltyPoints;
+    quint16 length;
+    char command;
+};
+
+// capacity must be a power of two
+template <int Capacity>
+class Ring
+{
+public:
+    Ring() : next(0) {}
+
+    Event *record(qint64 time, quint32 clientId, char command, quint16 length, qint32 penaltyPoints)
+    {
+        Event *event = &events[next++ & (Capacity - 1)];
+        event->time = time;
+        event->clientId = clientId;
+        event->command = command;
+        event->length = length;
+        event->replySize = 0;
+        event->penaltyPoints = penaltyPoints;
+        return event;
+    }
+
+    int size() const {return next < quint32(Capacity) ? next : Capacity;}
+
+    // i-th event from the oldest one still in the ring
+    const Event &at(int i) const {return events[(next - size() + i) & (Capacity - 1)];}
+
+private:
+    Event events[Capacity];
+    quint32 next;
+
+};
+
+}
+
+#endif // FLIGHTRECORDER_H
@@ -0,0 +1,176 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "heartbeatreceiver.h"
+#include "planet.h"
+
+#include <QDateTime>
+#include <QFile>
+#include <QHostAddress>
+#include <QUdpSocket>
+
+HeartbeatReceiver::HeartbeatReceiver(Planet *planet) : QObject(planet), planet(planet), receivedCount(0), rejectedCount(0)
+{
+    socket = new QUdpSocket(this);
+    connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+}
+
+bool HeartbeatReceiver::start(const QString &address, quint16 port)
+{
+    if (!socket->bind(QHostAddress(address), port)) {
+        qWarning("Failed to listen for heartbeats on %s:%u. %s.", qPrintable(address), port, qPrintable(socket->errorString()));
+        return false;
+    }
+
+    qDebug("Listening for heartbeats on %s:%u.", qPrintable(address), port);
+    return true;
+}
+
+bool HeartbeatReceiver::isListening() const
+{
+    return socket->state() == QAbstractSocket::BoundState;
+}
+
+quint16 HeartbeatReceiver::getPort() const
+{
+    return socket->localPort();
+}
+
+quint64 HeartbeatReceiver::generateToken()
+{
+    quint64 token = 0;
+
+    QFile random("/dev/urandom");
+    if (!random.open(QIODevice::ReadOnly) || random.read(reinterpret_cast<char*>(&token), sizeof(token)) != sizeof(token)) {
+        // not as good, but still unique enough to tell servers apart
+        token = (quint64(qrand()) << 48) ^ (quint64(qrand()) << 24) ^ quint64(qrand()) ^ quint64(QDateTime::currentMSecsSinceEpoch());
+    }
+
+    return token == 0 ? 1 : token;
+}
+
+bool HeartbeatReceiver::parse(const char *datagram, int length, Heartbeat &result)
+{
+    // split into the \r terminated fields
+    const char *fields[7];
+    int lengths[7];
+    int count = 0;
+
+    if (length < 1 || datagram[0] != 'H') {
+        return false;
+    }
+
+    const char *field = datagram + 1;
+    for (const char *p = field; p < datagram + length; p ++) {
+        if (*p != '\r') {
+            continue;
+        }
+        if (count == 7) {
+            return false;
+        }
+        fields[count] = field;
+        lengths[count] = p - field;
+        count ++;
+        field = p + 1;
+    }
+
+    if (count != 7 || field != datagram + length) {
+        return false;
+    }
+
+    if (lengths[0] != 16) {
+        return false;
+    }
+    result.token = 0;
+    for (int i = 0; i < 16; i ++) {
+        char c = fields[0][i];
+        int digit;
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return false;
+        }
+        result.token = (result.token << 4) | digit;
+    }
+
+    if (lengths[1] < 1 || lengths[1] > 5) {
+        return false;
+    }
+    quint32 port = 0;
+    for (int i = 0; i < lengths[1]; i ++) {
+        if (fields[1][i] < '0' || fields[1][i] > '9') {
+            return false;
+        }
+        port = port * 10 + (fields[1][i] - '0');
+    }
+    if (port > 65535) {
+        return false;
+    }
+    result.port = port;
+
+    result.hostname = fields[2];
+    result.hostnameLength = lengths[2];
+    result.mapname = fields[3];
+    result.mapnameLength = lengths[3];
+
+    // single characters, same as in the ?P, ?C and ?M commands
+    if (lengths[4] != 1 || lengths[5] != 1 || lengths[6] != 1) {
+        return false;
+    }
+    result.gametype = fields[4][0];
+    result.currentUsers = fields[5][0];
+    result.maxUsers = fields[6][0];
+
+    return true;
+}
+
+void HeartbeatReceiver::onReadyRead()
+{
+    char datagram[MAX_DATAGRAM_SIZE];
+    QHostAddress sender;
+    quint16 senderPort;
+
+    while (socket->hasPendingDatagrams()) {
+        qint64 length = socket->readDatagram(datagram, sizeof(datagram), &sender, &senderPort);
+        if (length < 0) {
+            break;
+        }
+
+        receivedCount ++;
+
+        Heartbeat heartbeat;
+        if (!parse(datagram, length, heartbeat)) {
+            rejectedCount ++;
+            qDebug("Malformed heartbeat from %s:%u. Dropped.", qPrintable(sender.toString()), senderPort);
+            continue;
+        }
+
+        if (!planet->handleHeartbeat(sender, heartbeat)) {
+            rejectedCount ++;
+        }
+    }
+}
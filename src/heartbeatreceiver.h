@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HEARTBEATRECEIVER_H
+#define HEARTBEATRECEIVER_H
+
+#include <QObject>
+
+class Planet;
+class QHostAddress;
+class QUdpSocket;
+
+// Receives UDP heartbeats of game servers.
+//
+// A game server registers over TCP as usual, asks for a token with ?T and may then close its
+// connection and keep its entry alive by sending a datagram every now and then instead:
+//
+//   H<token>\r<port>\r<hostname>\r<mapname>\r<gametype>\r<current players>\r<max players>\r
+//
+// where token is the 16 hex digits it was given. Heartbeats are not acknowledged. Entries that
+// stop receiving them expire.
+class HeartbeatReceiver : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HeartbeatReceiver(Planet *planet);
+
+    struct Heartbeat {
+        quint64 token;
+        quint16 port;
+        // point into the datagram
+        const char *hostname;
+        int hostnameLength;
+        const char *mapname;
+        int mapnameLength;
+        char gametype;
+        char currentUsers;
+        char maxUsers;
+    };
+
+    bool start(const QString &address, quint16 port);
+    bool isListening() const;
+    quint16 getPort() const;
+
+    quint64 getReceivedCount() const {return receivedCount;}
+    quint64 getRejectedCount() const {return rejectedCount;}
+
+    // hard to guess, never 0
+    static quint64 generateToken();
+
+private:
+    Planet *planet;
+    QUdpSocket *socket;
+
+    quint64 receivedCount;
+    quint64 rejectedCount;
+
+    // a heartbeat with the longest names still fits
+    static const int MAX_DATAGRAM_SIZE = 1024;
+
+    static bool parse(const char *datagram, int length, Heartbeat &result);
+
+private slots:
+    void onReadyRead();
+
+};
+
+#endif // HEARTBEATRECEIVER_H
@@ -0,0 +1,328 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "adminserver.h"
+#include "client.h"
+#include "httpexport.h"
+#include "planet.h"
+#include "server.h"
+
+#include <QDateTime>
+#include <QHostAddress>
+#include <QList>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <zlib.h>
+
+HttpExport::HttpExport(Planet *planet) : QObject(planet), planet(planet), bodyVersion(0), startTime(QDateTime::currentMSecsSinceEpoch())
+{
+    server = new QTcpServer(this);
+    connect(server, SIGNAL(newConnection()), this, SLOT(onConnection()));
+
+    idleCheckTimer = new QTimer(this);
+    connect(idleCheckTimer, SIGNAL(timeout()), this, SLOT(onIdleCheck()));
+}
+
+bool HttpExport::start(const QString &address, quint16 port)
+{
+    if (!server->listen(QHostAddress(address), port)) {
+        qWarning("Failed to start HTTP export on %s:%u. %s.", qPrintable(address), port, qPrintable(server->errorString()));
+        return false;
+    }
+
+    idleCheckTimer->start(IDLE_TIMEOUT / 2);
+
+    // build the body now, so that the version check always has something to compare against
+    bodyVersion = planet->getRegistryVersion() - 1;
+    updateBody();
+
+    qDebug("HTTP export is listening on %s:%u.", qPrintable(address), port);
+    return true;
+}
+
+QByteArray HttpExport::gzip(const QByteArray &data)
+{
+    QByteArray result;
+
+    z_stream stream;
+    stream.zalloc = Z_NULL;
+    stream.zfree = Z_NULL;
+    stream.opaque = Z_NULL;
+
+    // 16 added to the window bits asks zlib for a gzip wrapper instead of a zlib one
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        qWarning("Failed to initialize gzip compression.");
+        return result;
+    }
+
+    result.resize(deflateBound(&stream, data.size()));
+
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.constData()));
+    stream.avail_in = data.size();
+    stream.next_out = reinterpret_cast<Bytef*>(result.data());
+    stream.avail_out = result.size();
+
+    if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+        qWarning("Failed to gzip HTTP export body.");
+        result.clear();
+    } else {
+        result.resize(stream.total_out);
+    }
+
+    deflateEnd(&stream);
+
+    return result;
+}
+
+void HttpExport::updateBody()
+{
+    if (bodyVersion == planet->getRegistryVersion()) {
+        return;
+    }
+
+    bodyVersion = planet->getRegistryVersion();
+
+    const QList<Server*> &servers = planet->getServers();
+
+    body.clear();
+    body.reserve(160 * servers.size() + 16);
+    body.append("{\"servers\":[");
+
+    bool first = true;
+    for (int i = 0; i < servers.size(); i ++) {
+        Server *server = servers[i];
+        if (server->hidden) {
+            continue;
+        }
+
+        if (!first) {
+            body.append(',');
+        }
+        first = false;
+
+        // appended piece by piece, QString::arg() would substitute any %N a server put in its hostname or map
+        body.append("{\"ip\":").append(AdminServer::jsonString(server->getIp()));
+        body.append(",\"port\":").append(QByteArray::number(server->port));
+        body.append(",\"hostname\":").append(AdminServer::jsonString(server->getHostname()));
+        body.append(",\"map\":").append(AdminServer::jsonString(server->getMapname()));
+        body.append(",\"gametype\":").append(AdminServer::jsonString(server->getGametypeString()));
+        body.append(",\"players\":").append(QByteArray::number(server->getPlayers()));
+        body.append(",\"maxPlayers\":").append(QByteArray::number(server->getMaxPlayers()));
+        body.append(",\"latency\":").append(QByteArray::number(server->latency));
+        body.append('}');
+    }
+
+    body.append("]}\n");
+
+    gzippedBody = gzip(body);
+    etag = QString("\"%1-%2\"").arg(startTime).arg(bodyVersion).toAscii();
+
+    qDebug("Regenerated HTTP export body: %d bytes, %d bytes gzipped.", body.size(), gzippedBody.size());
+}
+
+void HttpExport::onConnection()
+{
+    while (server->hasPendingConnections()) {
+        QTcpSocket *socket = server->nextPendingConnection();
+
+        if (connections.size() >= MAX_CONNECTIONS) {
+            socket->abort();
+            socket->deleteLater();
+            continue;
+        }
+
+        // Qt stops reading from the network once this is buffered, so a client that doesn't take
+        // its replies is held back by TCP rather than by our memory
+        socket->setReadBufferSize(MAX_REQUEST_SIZE);
+
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(bytesWritten(qint64)), this, SLOT(onBytesWritten()));
+        connect(socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+
+        Connection connection;
+        connection.lastActive = QDateTime::currentMSecsSinceEpoch();
+        connections.insert(socket, connection);
+    }
+}
+
+void HttpExport::onDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    connections.remove(socket);
+    socket->deleteLater();
+}
+
+void HttpExport::onIdleCheck()
+{
+    qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
+
+    // disconnecting removes sockets from connections, so collect them first
+    QList<QTcpSocket*> idle;
+    for (QHash<QTcpSocket*, Connection>::const_iterator it = connections.constBegin(); it != connections.constEnd(); ++ it) {
+        if (currentTime - it.value().lastActive > IDLE_TIMEOUT) {
+            idle << it.key();
+        }
+    }
+
+    foreach (QTcpSocket *socket, idle) {
+        socket->abort();
+    }
+}
+
+void HttpExport::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    QHash<QTcpSocket*, Connection>::iterator it = connections.find(socket);
+    if (it == connections.end()) {
+        return;
+    }
+
+    it.value().lastActive = QDateTime::currentMSecsSinceEpoch();
+    processRequests(socket, it.value());
+}
+
+void HttpExport::onBytesWritten()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    QHash<QTcpSocket*, Connection>::iterator it = connections.find(socket);
+    if (it == connections.end()) {
+        return;
+    }
+
+    // a client that is taking its replies is not idle, however slowly it does so
+    it.value().lastActive = QDateTime::currentMSecsSinceEpoch();
+    processRequests(socket, it.value());
+}
+
+void HttpExport::processRequests(QTcpSocket *socket, Connection &connection)
+{
+    // there might be several pipelined requests, each of them is read only once the replies
+    // to the previous ones are mostly sent, the rest waits in the socket
+    while (socket->state() == QAbstractSocket::ConnectedState && socket->bytesToWrite() <= MAX_PENDING_OUTPUT) {
+        int end = connection.buffer.indexOf("\r\n\r\n");
+        if (end == -1) {
+            if (connection.buffer.size() > MAX_REQUEST_SIZE) {
+                sendStatus(socket, "431 Request Header Fields Too Large");
+                socket->disconnectFromHost();
+                return;
+            }
+            if (socket->bytesAvailable() == 0) {
+                return;
+            }
+            connection.buffer.append(socket->read(MAX_REQUEST_SIZE));
+            continue;
+        }
+
+        QByteArray request = connection.buffer.left(end);
+        connection.buffer.remove(0, end + 4);
+
+        if (!handleRequest(socket, request)) {
+            socket->disconnectFromHost();
+            return;
+        }
+    }
+}
+
+void HttpExport::sendStatus(QTcpSocket *socket, const char *status)
+{
+    socket->write(QString("HTTP/1.1 %1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n").arg(status).toAscii());
+}
+
+bool HttpExport::handleRequest(QTcpSocket *socket, const QByteArray &request)
+{
+    QList<QByteArray> lines = request.split('\n');
+    QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+
+    if (requestLine.size() != 3) {
+        sendStatus(socket, "400 Bad Request");
+        return false;
+    }
+
+    const QByteArray &method = requestLine[0];
+    const QByteArray &path = requestLine[1];
+    bool keepAlive = requestLine[2] == "HTTP/1.1";
+
+    bool acceptsGzip = false;
+    QByteArray ifNoneMatch;
+
+    foreach (const QByteArray &line, lines) {
+        int colon = line.indexOf(':');
+        if (colon == -1) {
+            continue;
+        }
+        QByteArray name = line.left(colon).trimmed().toLower();
+        QByteArray value = line.mid(colon + 1).trimmed();
+
+        if (name == "accept-encoding") {
+            acceptsGzip = value.contains("gzip");
+        } else if (name == "if-none-match") {
+            ifNoneMatch = value;
+        } else if (name == "connection") {
+            value = value.toLower();
+            if (value == "close") {
+                keepAlive = false;
+            } else if (value == "keep-alive") {
+                keepAlive = true;
+            }
+        }
+    }
+
+    if (method != "GET" && method != "HEAD") {
+        sendStatus(socket, "405 Method Not Allowed");
+        return false;
+    }
+
+    if (path != "/" && path != "/servers.json") {
+        sendStatus(socket, "404 Not Found");
+        return false;
+    }
+
+    updateBody();
+
+    QByteArray header = "HTTP/1.1 ";
+
+    if (!ifNoneMatch.isEmpty() && (ifNoneMatch.contains(etag) || ifNoneMatch == "*")) {
+        header.append("304 Not Modified\r\nETag: " + etag + "\r\n");
+        header.append(keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+        socket->write(header);
+        return keepAlive;
+    }
+
+    const QByteArray &content = acceptsGzip && !gzippedBody.isEmpty() ? gzippedBody : body;
+
+    header.append("200 OK\r\nContent-Type: application/json; charset=utf-8\r\nCache-Control: no-cache\r\nVary: Accept-Encoding\r\nETag: " + etag + "\r\n");
+    if (&content == &gzippedBody) {
+        header.append("Content-Encoding: gzip\r\n");
+    }
+    header.append(QString("Content-Length: %1\r\n").arg(content.size()).toAscii());
+    header.append(keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+
+    socket->write(header);
+    if (method == "GET") {
+        socket->write(content);
+    }
+
+    return keepAlive;
+}
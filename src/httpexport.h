@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef HTTPEXPORT_H
+#define HTTPEXPORT_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+
+class Planet;
+class QTcpServer;
+class QTcpSocket;
+class QTimer;
+
+// Read-only HTTP endpoint serving the server list as JSON, for websites and bots.
+//
+// The body is generated once per registry version and kept both as is and gzipped, so serving
+// a request is just writing out a cached buffer. Clients that send the current ETag in
+// If-None-Match get a 304 without a body. Pipelined requests are answered only as fast as the
+// client takes the replies.
+class HttpExport : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HttpExport(Planet *planet);
+
+    bool start(const QString &address, quint16 port);
+
+private:
+    struct Connection {
+        QByteArray buffer;
+        qint64 lastActive;
+    };
+
+    Planet *planet;
+    QTcpServer *server;
+    QTimer *idleCheckTimer;
+    QHash<QTcpSocket*, Connection> connections;
+
+    quint64 bodyVersion;
+    QByteArray body;
+    QByteArray gzippedBody;
+    QByteArray etag;
+    // makes ETags of different planet runs differ, since the registry version starts over with every run
+    qint64 startTime;
+
+    // requests with bigger headers are refused
+    static const int MAX_REQUEST_SIZE = 8*1024;
+    static const int MAX_CONNECTIONS = 1024;
+    static const int IDLE_TIMEOUT = 30*1000;
+    // don't answer more requests while this much of the previous replies is still waiting to be sent
+    static const int MAX_PENDING_OUTPUT = 64*1024;
+
+    void updateBody();
+    void processRequests(QTcpSocket *socket, Connection &connection);
+    // returns false if the connection should be closed
+    bool handleRequest(QTcpSocket *socket, const QByteArray &request);
+    void sendStatus(QTcpSocket *socket, const char *status);
+
+    static QByteArray gzip(const QByteArray &data);
+
+private slots:
+    void onConnection();
+    void onReadyRead();
+    void onBytesWritten();
+    void onDisconnected();
+    void onIdleCheck();
+
+};
+
+#endif // HTTPEXPORT_H
@@ -0,0 +1,175 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "loadmonitor.h"
+#include "settings.h"
+
+#include <QTimer>
+
+#include <cstdio>
+#include <cstdlib>
+
+bool LoadMonitor::shedDebugMessages = false;
+
+// what Qt does when no handler has been installed
+static void writeMessage(QtMsgType type, const char *message)
+{
+    fprintf(stderr, "%s\n", message);
+    fflush(stderr);
+    if (type == QtFatalMsg) {
+        abort();
+    }
+}
+
+#if QT_VERSION >= 0x050000
+static QtMessageHandler previousMessageHandler = NULL;
+
+static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    if (type == QtDebugMsg && LoadMonitor::isSheddingDebugMessages()) {
+        return;
+    }
+    if (previousMessageHandler != NULL) {
+        previousMessageHandler(type, context, message);
+    } else {
+        writeMessage(type, qPrintable(message));
+    }
+}
+#else
+static QtMsgHandler previousMessageHandler = NULL;
+
+static void messageHandler(QtMsgType type, const char *message)
+{
+    if (type == QtDebugMsg && LoadMonitor::isSheddingDebugMessages()) {
+        return;
+    }
+    if (previousMessageHandler != NULL) {
+        previousMessageHandler(type, message);
+    } else {
+        writeMessage(type, message);
+    }
+}
+#endif
+
+LoadMonitor::LoadMonitor(QObject *parent) : QObject(parent), lastSample(0), lag(0), maxLag(0), level(Normal), levelSince(0), calmSince(-1), settings(Settings::getInstance())
+{
+    for (int i = 0; i < LevelCount; i ++) {
+        transitions[i] = 0;
+        timeInLevel[i] = 0;
+    }
+
+    sampleTimer = new QTimer(this);
+    connect(sampleTimer, SIGNAL(timeout()), this, SLOT(onSample()));
+
+    clock.start();
+}
+
+void LoadMonitor::start()
+{
+    lastSample = clock.elapsed();
+    sampleTimer->start(qMax(settings.getLoadSampleMilliseconds(), 1));
+}
+
+void LoadMonitor::installMessageHandler()
+{
+#if QT_VERSION >= 0x050000
+    previousMessageHandler = qInstallMessageHandler(messageHandler);
+#else
+    previousMessageHandler = qInstallMsgHandler(messageHandler);
+#endif
+}
+
+const char *LoadMonitor::getLevelName(int level)
+{
+    switch (level) {
+        case Normal:
+            return "normal";
+        case Degraded:
+            return "degraded";
+        case Overloaded:
+            return "overloaded";
+        default:
+            return "unknown";
+    }
+}
+
+qint64 LoadMonitor::getTimeInLevel(int level) const
+{
+    return timeInLevel[level] + (level == this->level ? clock.elapsed() - levelSince : 0);
+}
+
+int LoadMonitor::threshold(int level) const
+{
+    return level == Overloaded ? settings.getOverloadedLagMilliseconds() : settings.getDegradedLagMilliseconds();
+}
+
+void LoadMonitor::onSample()
+{
+    qint64 now = clock.elapsed();
+    int sampleLag = qMax(qint64(0), now - lastSample - sampleTimer->interval());
+    lastSample = now;
+
+    // rise right away, fall slowly, so that a single quick sample doesn't hide a stall
+    lag = sampleLag > lag ? sampleLag : (lag * 7 + sampleLag) / 8;
+    maxLag = qMax(maxLag, sampleLag);
+
+    Level target = Normal;
+    if (lag >= settings.getOverloadedLagMilliseconds()) {
+        target = Overloaded;
+    } else if (lag >= settings.getDegradedLagMilliseconds()) {
+        target = Degraded;
+    }
+
+    if (target > level) {
+        setLevel(target, now);
+        return;
+    }
+
+    if (level == Normal) {
+        return;
+    }
+
+    // step down once the lag has stayed this far below the current level's threshold for long enough
+    if (lag * 100 >= threshold(level) * settings.getLoadRecoverPercent()) {
+        calmSince = -1;
+    } else if (calmSince < 0) {
+        calmSince = now;
+    } else if (now - calmSince >= settings.getLoadRecoverSeconds() * 1000) {
+        setLevel(Level(level - 1), now);
+    }
+}
+
+void LoadMonitor::setLevel(Level newLevel, qint64 now)
+{
+    Level previousLevel = level;
+
+    timeInLevel[level] += now - levelSince;
+    level = newLevel;
+    levelSince = now;
+    calmSince = -1;
+    transitions[level] ++;
+
+    shedDebugMessages = level != Normal && settings.getLoadShedDebugMessages();
+
+    emit levelChanged(level, previousLevel);
+}
@@ -0,0 +1,101 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef LOADMONITOR_H
+#define LOADMONITOR_H
+
+#include <QElapsedTimer>
+#include <QObject>
+
+class QTimer;
+class Settings;
+
+// Measures how late the event loop runs a timer and derives a load level from it.
+//
+// A timer is due every sample interval, anything on top of that is time the event loop spent
+// elsewhere, which is also how much longer every client waits for a reply. The level goes up as
+// soon as the lag crosses a threshold, but goes down only one level at a time and only after the
+// lag has stayed well below the threshold for a while, so that it doesn't flap.
+class LoadMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    explicit LoadMonitor(QObject *parent = 0);
+
+    enum Level {
+        Normal,
+        // ?G is served from a snapshot that is rebuilt less often, penalties are raised
+        Degraded,
+        // in addition, new connections are rejected
+        Overloaded,
+        LevelCount
+    };
+
+    void start();
+
+    Level getLevel() const {return level;}
+    static const char *getLevelName(int level);
+
+    // smoothed lag in milliseconds
+    int getLag() const {return lag;}
+    int getMaxLag() const {return maxLag;}
+    // number of times the level has changed to the given one
+    quint64 getTransitions(int level) const {return transitions[level];}
+    // milliseconds spent in the given level, including the current stretch
+    qint64 getTimeInLevel(int level) const;
+
+    // while the level is not Normal, debug messages are dropped instead of written out
+    static void installMessageHandler();
+    static bool isSheddingDebugMessages() {return shedDebugMessages;}
+
+signals:
+    void levelChanged(int level, int previousLevel);
+
+private:
+    QTimer *sampleTimer;
+    QElapsedTimer clock;
+    qint64 lastSample;
+
+    int lag;
+    int maxLag;
+    Level level;
+    qint64 levelSince;
+    // when the lag went below the threshold of the current level, -1 if it is not below it
+    qint64 calmSince;
+
+    quint64 transitions[LevelCount];
+    qint64 timeInLevel[LevelCount];
+
+    Settings &settings;
+
+    static bool shedDebugMessages;
+
+    int threshold(int level) const;
+    void setLevel(Level newLevel, qint64 now);
+
+private slots:
+    void onSample();
+
+};
+
+#endif // LOADMONITOR_H
@@ -21,20 +21,65 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include "abusedetector.h"
+#include "acceptor.h"
+#include "adminserver.h"
 #include "client.h"
+#include "clock.h"
+#include "httpexport.h"
+#include "loadmonitor.h"
 #include "planet.h"
+#include "prober.h"
 #include "server.h"
+#include "statshistory.h"
+#include "trafficrecorder.h"
+#include "transport.h"
 
 #include <QDateTime>
 #include <QDebug>
+#include <QFile>
+#include <QSocketNotifier>
 #include <QString>
 #include <QStringList>
 #include <QTcpServer>
 #include <QTcpSocket>
+#include <QTextStream>
 #include <QTimer>
 
+#include <cstring>
+#include <zlib.h>
+
+#ifdef Q_OS_UNIX
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 const char Planet::PLANET_VERSION[] = "077";
 
+const char Planet::PLANET_EXTENSIONS[] = "FHZ";
+
+int Planet::sigusr1Fd[2];
+
+const Planet::Command Planet::COMMANDS[] = {
+    {'V', &Planet::handleVersionRequest,              &Settings::getVersionRequestPenalty,              0,  0,                                     false, "request the planet version"},
+    {'G', &Planet::handleServerListRequest,           &Settings::getServerListRequestPenalty,           1,  0,                                     false, "request the server list"},
+    {'F', &Planet::handleFilteredServerListRequest,   &Settings::getFilteredServerListRequestPenalty,   1,  Client::FilteredServerListExtension,   false, "request a filtered server list"},
+    {'R', &Planet::handleServerRegistration,          &Settings::getServerRegistrationPenalty,          76, 0,                                     false, "register a server"},
+    {'N', &Planet::handleSetServerName,               &Settings::getSetServerNamePenalty,               1,  0,                                     true,  "set server name"},
+    {'m', &Planet::handleSetServerMap,                &Settings::getSetServerMapPenalty,                1,  0,                                     true,  "set server map name"},
+    {'C', &Planet::handleSetPlayersCount,             &Settings::getSetPlayersCountPenalty,             1,  0,                                     true,  "set current player count"},
+    {'M', &Planet::handleSetMaxPlayersCount,          &Settings::getSetMaxPlayersCountPenalty,          1,  0,                                     true,  "set server maximum player count"},
+    {'P', &Planet::handleSetGameType,                 &Settings::getSetGameTypePenalty,                 1,  0,                                     true,  "set server game type"},
+    {'S', &Planet::handleNumberOfClientsRequest,      &Settings::getNumberOfClientsRequestPenalty,      1,  0,                                     false, "request the number of connected clients"},
+    {'K', &Planet::handlePing,                        &Settings::getPingRequestPenalty,                 1,  0,                                     false, "ping"},
+    {'X', &Planet::handleInviteRequest,               &Settings::getInviteRequestPenalty,               1,  0,                                     false, "ask for an invite"},
+    {'T', &Planet::handleHeartbeatTokenRequest,       &Settings::getHeartbeatTokenRequestPenalty,       1,  Client::HeartbeatExtension,            true,  "request a heartbeat token"},
+    {'Z', &Planet::handleCompressedServerListRequest, &Settings::getCompressedServerListRequestPenalty, 77, Client::CompressedServerListExtension, false, "request the compressed server list"}
+};
+
+const int Planet::COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
 const char Planet::OLD_VERSION_MESSAGE[] = "L127.0.0.1\rYour version of NF\rK is too old\r1\r1\r1\r\n\0"
         "L127.0.0.1\rPlease download\rthe latest version\r1\r1\r1\r\n\0"
         "L127.0.0.1\rfrom\r^2needforkill.ru     \r1\r1\r1\r\n\0"
@@ -42,7 +87,7 @@ const char Planet::OLD_VERSION_MESSAGE[] = "L127.0.0.1\rYour version of NF\rK is
         "L127.0.0.1\rCKA4AUTE HOBY|-0\rNFK C CAUTA\r1\r1\r1\r\n\0"
         "L127.0.0.1\r^2needforkill.ru    \r\r1\r1\r1\r\n\0E\n\0";
 
-Planet::Planet() : settings(Settings::getInstance())
+Planet::Planet() : admittedConnections(0), lastClientId(0), sigusr1Notifier(NULL), registryVersion(0), overloadRejections(0), lastServerId(0), settings(Settings::getInstance())
 {
     // check version for sanety
     bool ok;
@@ -55,77 +100,514 @@ Planet::Planet() : settings(Settings::getInstance())
     pingCheckTimer = new QTimer(this);
     pingCheckTimer->setInterval(CHECK_PING_TIMEOUT);
     connect(pingCheckTimer, SIGNAL(timeout()), this, SLOT(onPingCheck()));
-    pingCheckTimer->start(CHECK_PING_TIMEOUT);
 
-    server = new QTcpServer(this);
+    server = new Acceptor(this);
     connect(server, SIGNAL(newConnection()), this, SLOT(onClientConnect()));
+
+    prober = new Prober(this);
+    connect(prober, SIGNAL(serverVisibilityChanged(Server*)), this, SLOT(onServerVisibilityChanged()));
+
+    trafficRecorder = new TrafficRecorder(this);
+
+    abuseDetector = new AbuseDetector(this);
+
+    adminServer = new AdminServer(this);
+
+    httpExport = new HttpExport(this);
+
+    heartbeatReceiver = new HeartbeatReceiver(this);
+
+    statsHistory = new StatsHistory(this);
+    // heartbeats are agreed to only once the receiver is listening
+    enabledExtensions = Client::FilteredServerListExtension;
+    if (settings.getServerListCompressionLevel() > 0) {
+        enabledExtensions |= Client::CompressedServerListExtension;
+    }
+
+    // fires as soon as the event loop has nothing else to do
+    readyQueueTimer = new QTimer(this);
+    readyQueueTimer->setSingleShot(true);
+    readyQueueTimer->setInterval(0);
+    connect(readyQueueTimer, SIGNAL(timeout()), this, SLOT(onReadyQueue()));
+
+    loadMonitor = new LoadMonitor(this);
+    connect(loadMonitor, SIGNAL(levelChanged(int,int)), this, SLOT(onLoadLevelChanged(int,int)));
+
+    uptime.start();
+
+    // index the command descriptors by their command byte
+    memset(commandTable, 0, sizeof(commandTable));
+    memset(commandStats, 0, sizeof(commandStats));
+    for (int i = 0; i < COMMAND_COUNT; i ++) {
+        commandTable[static_cast<uchar>(COMMANDS[i].command)] = &COMMANDS[i];
+    }
+
+#ifdef Q_OS_UNIX
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sigusr1Fd) != 0) {
+        qWarning("Failed to create a socket pair for SIGUSR1 handling. Flight recorder can't be dumped with a signal.");
+    } else {
+        sigusr1Notifier = new QSocketNotifier(sigusr1Fd[1], QSocketNotifier::Read, this);
+        connect(sigusr1Notifier, SIGNAL(activated(int)), this, SLOT(onSigusr1()));
+
+        struct sigaction action;
+        action.sa_handler = sigusr1Handler;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        if (sigaction(SIGUSR1, &action, NULL) != 0) {
+            qWarning("Failed to set SIGUSR1 handler. Flight recorder can't be dumped with a signal.");
+        }
+    }
+#endif
+
+    // make sure the caches get built on the first request
+    serverListCacheVersion[0] = serverListCacheVersion[1] = registryVersion - 1;
+    serverListCacheTime[0] = serverListCacheTime[1] = 0;
+    compressedServerListCacheVersion = serverListCacheVersion[1];
+    compressedServerListsSent = compressedServerListRawBytes = compressedServerListBytes = 0;
 }
 
 void Planet::onPingCheck()
 {
-    qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
+    qint64 currentTime = Clock::get()->currentMSecsSinceEpoch();
+
+    qint64 slowClientTimeout = settings.getSlowClientTimeoutSeconds() * 1000;
 
-    Client *client;
+    // disconnecting might remove a client from clientList right away, so collect them first
+    QList<Client*> timedOut;
+    QList<Client*> tooSlow;
 
-    QMutableListIterator<Client*> it(clientList);
-    while (it.hasNext()) {
-        client = it.next();
+    for (int i = 0; i < clientList.size(); i ++) {
+        Client *client = clientList[i];
         if (currentTime - client->lastPinged > CLIENT_PING_TIMEOUT) {
-            qDebug("Client %s:%u ping timeout.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-            client->sock->disconnectFromHost();
+            timedOut << client;
+        } else if (client->overLimitSince != 0 && currentTime - client->overLimitSince > slowClientTimeout) {
+            tooSlow << client;
         }
     }
+
+    foreach (Client *client, timedOut) {
+        qDebug("Client %s:%u ping timeout.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+        disconnectClient(client);
+    }
+
+    foreach (Client *client, tooSlow) {
+        qDebug("Client %s:%u didn't read its pending output (%lld bytes) for too long. Disconnecting.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), client->sock->bytesToWrite());
+        // there is no point in waiting for the output to be flushed, that's what we have been doing all along
+        disconnectClient(client, true);
+    }
+
+    qint64 heartbeatTimeout = settings.getHeartbeatTimeoutSeconds() * 1000;
+    QList<Server*> expired;
+
+    foreach (Server *server, heartbeatServers) {
+        if (server->client == NULL && currentTime - server->lastHeartbeat > heartbeatTimeout) {
+            expired << server;
+        }
+    }
+
+    foreach (Server *server, expired) {
+        qDebug("Server %s:%u stopped sending heartbeats. Removing it.", qPrintable(server->getIp()), server->port);
+        removeServer(server);
+    }
+}
+
+void Planet::appendServerEntry(QByteArray &servers, Server *server, bool withPorts, bool withLatency)
+{
+    // L<ip>\r<hostname>\r<mapname>\r<gametype>\r<current>\r<max>\r[<port>\r][<latency>\r]\n\0
+    // the entry is assembled in place, no temporary strings
+    char numbers[32];
+    int numbersLength = 0;
+
+    if (withPorts) {
+        numbersLength += qsnprintf(numbers + numbersLength, sizeof(numbers) - numbersLength, "%u\r", server->port);
+    }
+
+    if (withLatency) {
+        numbersLength += qsnprintf(numbers + numbersLength, sizeof(numbers) - numbersLength, "%d\r", server->latency);
+    }
+
+    const char fields[] = {server->gametype, '\r', server->currentUsers, '\r', server->maxUsers, '\r'};
+
+    servers.append('L');
+    servers.append(server->ipData(), server->ipLength);
+    servers.append('\r');
+    servers.append(server->hostnameData(), server->hostnameLength);
+    servers.append('\r');
+    servers.append(server->mapnameData(), server->mapnameLength);
+    servers.append('\r');
+    servers.append(fields, sizeof(fields));
+    servers.append(numbers, numbersLength);
+    servers.append("\n", 2);
+}
+
+const QByteArray &Planet::getServerList(bool withPorts)
+{
+    int i = withPorts ? 1 : 0;
+
+    QByteArray &servers = serverListCache[i];
+
+    if (serverListCacheVersion[i] == registryVersion) {
+        return servers;
+    }
+
+    // rebuilding on every change is what we can't afford when the event loop is falling behind
+    if (loadMonitor->getLevel() != LoadMonitor::Normal && !servers.isEmpty()
+            && uptime.elapsed() - serverListCacheTime[i] < settings.getDegradedServerListRefreshSeconds() * 1000) {
+        return servers;
+    }
+
+    servers.clear();
+    // value from the original nfkplanet
+    servers.reserve(90 * serverList.size() + 3);
+
+    for (int j = 0; j < serverList.size(); j ++) {
+        if (!serverList[j]->hidden) {
+            appendServerEntry(servers, serverList[j], withPorts);
+        }
+    }
+
+    servers.append("E\n", 2);
+    servers.append('\0');
+
+    serverListCacheVersion[i] = registryVersion;
+    serverListCacheTime[i] = uptime.elapsed();
+
+    return servers;
+}
+
+void Planet::sendServerList(Client *client)
+{
+    const QByteArray &servers = getServerList(client->version > 76);
+
+    if (client->sock->write(servers) != servers.size()) {
+        qCritical("Failed to send server list to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
+    } else {
+        qDebug("Successfully sent server list to client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+    }
+
+    if (client->overLimitSince == 0 && client->sock->bytesToWrite() > settings.getMaxPendingOutputBytes()) {
+        client->overLimitSince = Clock::get()->currentMSecsSinceEpoch();
+    }
+}
+
+const QByteArray &Planet::getCompressedServerList()
+{
+    const QByteArray &servers = getServerList(true);
+
+    // follows the plain list, so it's stale exactly when that one is
+    if (compressedServerListCacheVersion == serverListCacheVersion[1] && !compressedServerListCache.isEmpty()) {
+        return compressedServerListCache;
+    }
+
+    uLongf size = compressBound(servers.size());
+    QByteArray compressed(static_cast<int>(size), '\0');
+    int level = qMin(settings.getServerListCompressionLevel(), static_cast<int>(Z_BEST_COMPRESSION));
+    if (compress2(reinterpret_cast<Bytef*>(compressed.data()), &size, reinterpret_cast<const Bytef*>(servers.constData()), servers.size(), level) != Z_OK) {
+        qCritical("Failed to compress the server list of %d bytes.", servers.size());
+        compressedServerListCache.clear();
+        return compressedServerListCache;
+    }
+
+    // "Z<size> <compressed size>\n" followed by the zlib stream of the plain ?G reply
+    compressedServerListCache = QString("Z%1 %2\n").arg(servers.size()).arg(static_cast<qulonglong>(size)).toAscii();
+    compressedServerListCache.append(compressed.constData(), size);
+
+    compressedServerListCacheVersion = serverListCacheVersion[1];
+
+    return compressedServerListCache;
+}
+
+void Planet::sendCompressedServerList(Client *client)
+{
+    const QByteArray &servers = getCompressedServerList();
+
+    if (servers.isEmpty()) {
+        // nothing to lose by falling back to the list every client understands
+        sendServerList(client);
+        return;
+    }
+
+    if (client->sock->write(servers) != servers.size()) {
+        qCritical("Failed to send compressed server list to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
+    } else {
+        compressedServerListsSent ++;
+        compressedServerListRawBytes += serverListCache[1].size();
+        compressedServerListBytes += servers.size();
+        qDebug("Successfully sent compressed server list to client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+    }
+
+    if (client->overLimitSince == 0 && client->sock->bytesToWrite() > settings.getMaxPendingOutputBytes()) {
+        client->overLimitSince = Clock::get()->currentMSecsSinceEpoch();
+    }
+}
+
+bool Planet::deferServerList(Client *client, bool compressed)
+{
+    if (client->sock->bytesToWrite() <= settings.getMaxPendingOutputBytes()) {
+        return false;
+    }
+
+    /* the previous reply hasn't drained yet, coalesce this request into a single pending one */
+    client->serverListPending = true;
+    client->compressedServerListPending = compressed;
+    if (client->overLimitSince == 0) {
+        client->overLimitSince = Clock::get()->currentMSecsSinceEpoch();
+    }
+    qDebug("Client %s:%u is over its output limit (%lld bytes pending). Server list request deferred.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), client->sock->bytesToWrite());
+    return true;
+}
+
+bool Planet::parseServerListFilter(const char *filter, ServerIndex::Filter &result)
+{
+    result.limit = settings.getMaxServerListPageSize();
+
+    if (*filter == '\0') {
+        return true;
+    }
+
+    // \r separated fields, each starting with a letter identifying the predicate
+    QStringList fields = QString(filter).split('\r');
+
+    foreach (const QString &field, fields) {
+        if (field.isEmpty()) {
+            return false;
+        }
+
+        QString value = field.mid(1);
+        bool ok = true;
+
+        switch (field[0].toAscii()) {
+            case 'g':
+                if (value.size() != 1) {
+                    return false;
+                }
+                result.hasGametype = true;
+                result.gametype = value[0].toAscii();
+                break;
+            case 'm':
+                result.hasMapname = true;
+                result.mapname = value.toLatin1();
+                break;
+            case 'h':
+                result.hostnameSubstring = value.toLatin1();
+                break;
+            case 'e':
+                result.notEmpty = true;
+                break;
+            case 'f':
+                result.notFull = true;
+                break;
+            case 'c':
+                result.cursor = value.toUInt(&ok);
+                break;
+            case 'l': {
+                int limit = value.toInt(&ok);
+                if (ok && limit > 0 && limit < result.limit) {
+                    result.limit = limit;
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+
+        if (!ok) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Planet::sigusr1Handler(int)
+{
+#ifdef Q_OS_UNIX
+    char a = 1;
+    ssize_t ignored = ::write(sigusr1Fd[0], &a, sizeof(a));
+    Q_UNUSED(ignored);
+#endif
+}
+
+void Planet::onSigusr1()
+{
+#ifdef Q_OS_UNIX
+    sigusr1Notifier->setEnabled(false);
+    char a;
+    ssize_t ignored = ::read(sigusr1Fd[1], &a, sizeof(a));
+    Q_UNUSED(ignored);
+
+    QString filePath = QString("flightrecorder-%1.log").arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+    if (dumpFlightRecorder(filePath)) {
+        qWarning("Flight recorder dumped into %s.", qPrintable(filePath));
+    }
+
+    sigusr1Notifier->setEnabled(true);
+#endif
+}
+
+static void writeEvent(QTextStream &out, const FlightRecorder::Event &event)
+{
+    out << event.time << ' ' << event.clientId << ' ' << (event.command ? event.command : '-') << ' ' << event.length << ' ' << event.replySize << ' ' << event.penaltyPoints << '\n';
+}
+
+bool Planet::dumpFlightRecorder(const QString &filePath, Client *onlyClient)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qWarning("Failed to open %s for writing the flight recorder dump. %s.", qPrintable(filePath), qPrintable(file.errorString()));
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "# uptime " << uptime.elapsed() << " ms\n";
+    out << "# time clientId command length replySize penaltyPoints\n";
+
+    for (int i = 0; i < clientList.size(); i ++) {
+        Client *client = clientList[i];
+        if (onlyClient != NULL && client != onlyClient) {
+            continue;
+        }
+        out << "client " << client->id << ' ' << client->sock->peerAddress().toString() << ':' << client->sock->peerPort() << '\n';
+        for (int j = 0; j < client->events.size(); j ++) {
+            writeEvent(out, client->events.at(j));
+        }
+    }
+
+    if (onlyClient == NULL) {
+        out << "global\n";
+        for (int j = 0; j < globalEvents.size(); j ++) {
+            writeEvent(out, globalEvents.at(j));
+        }
+    }
+
+    return true;
 }
 
 void Planet::start(QString address, quint16 port)
 {
     qDebug("Trying to start listening on %s:%u.", qPrintable(address), port);
-    if (!server->listen(QHostAddress(address), port)) {
-        qFatal("Error: %s.", qPrintable(server->errorString()));
+    if (!server->listen(QHostAddress(address), port, settings.getListenBacklog())) {
+        qFatal("Error: %s.", qPrintable(server->getErrorString()));
         server->close();
         return;
     }
     qDebug("Listening for incoming connections.");
+
+    pingCheckTimer->start(CHECK_PING_TIMEOUT);
+
+    prober->start();
+
+    if (settings.getEnableAdmin()) {
+        adminServer->start(settings.getAdminSocket());
+    }
+
+    if (settings.getEnableHttp()) {
+        httpExport->start(settings.getHttpAddress(), settings.getHttpPort());
+    }
+
+    if (settings.getEnableHistory()) {
+        statsHistory->start(settings.getHistoryFile());
+    }
+
+    if (settings.getEnableHeartbeat() && heartbeatReceiver->start(settings.getHeartbeatAddress(), settings.getHeartbeatPort())) {
+        enabledExtensions |= Client::HeartbeatExtension;
+    }
+
+    if (settings.getEnableLoadMonitor()) {
+        LoadMonitor::installMessageHandler();
+        loadMonitor->start();
+    }
+
+    if (settings.getEnableCapture() && trafficRecorder->start(settings.getCaptureFile())) {
+        qWarning("Capturing traffic into %s.", qPrintable(settings.getCaptureFile()));
+    }
+}
+
+bool Planet::admitConnection(const QHostAddress &address)
+{
+    QString ip = address.toString();
+
+    if (loadMonitor->getLevel() == LoadMonitor::Overloaded) {
+        overloadRejections ++;
+        qDebug("Planet is overloaded. Rejecting connection from %s.", qPrintable(ip));
+        return false;
+    }
+
+    if (clientList.size() + admittedConnections >= settings.getMaxClients()) {
+        qDebug("Maximum number of clients (%d) reached. Rejecting connection from %s.", settings.getMaxClients(), qPrintable(ip));
+        return false;
+    }
+
+    if (settings.getBlacklistedIps().contains(ip)) {
+        qDebug("Rejecting connection from blacklisted IP %s.", qPrintable(ip));
+        return false;
+    }
+
+    int ipCount = clientIpCount.value(ip);
+    int maxConnectionsFromTheSameIp = settings.getMaxSimultaneousConnectionsFromSingleIp();
+    if (maxConnectionsFromTheSameIp >= 0 && ipCount >= maxConnectionsFromTheSameIp) {
+        qDebug("IP %s exceeded the number of maximum simultanious connections from single IP address (%d). Rejecting connection.", qPrintable(ip), maxConnectionsFromTheSameIp);
+        return false;
+    }
+
+    if (settings.getAbuseRejectHotPrefixes() && abuseDetector->isHotPrefix(address.toIPv4Address())) {
+        qDebug("Rejecting connection from %s, its network is sending too many commands.", qPrintable(ip));
+        return false;
+    }
+
+    clientIpCount[ip] = ipCount + 1;
+    admittedConnections ++;
+
+    return true;
+}
+
+void Planet::withdrawAdmission(const QHostAddress &address)
+{
+    QString ip = address.toString();
+
+    if (-- clientIpCount[ip] <= 0) {
+        clientIpCount.remove(ip);
+    }
+    admittedConnections --;
 }
 
 void Planet::onClientConnect()
 {
+    // pick up everything that has been accepted since the last time
+    while (server->hasPendingConnections()) {
+        addConnection(new TcpTransport(server->nextPendingConnection()));
+    }
+}
+
+void Planet::addConnection(Transport *transport)
+{
+    admittedConnections --;
+
     Client *client = new Client();
 
+    client->id = ++ lastClientId;
     client->version = 0;
-    client->lastPinged = QDateTime::currentMSecsSinceEpoch();
+    client->extensions = 0;
+    client->lastPinged = Clock::get()->currentMSecsSinceEpoch();
     client->server = NULL;
-    client->sock = server->nextPendingConnection();
+    client->serverListPending = false;
+    client->compressedServerListPending = false;
+    client->filteredServerListPending = false;
+    client->overLimitSince = 0;
+    client->readyQueued = false;
+    client->sock = transport;
     client->sock->setProperty("client", QVariant::fromValue(client));
+    client->ipv4 = client->sock->peerAddress().toIPv4Address();
 
     connect(client->sock, SIGNAL(readyRead()), this, SLOT(onClientReadReady()));
     connect(client->sock, SIGNAL(disconnected()), this, SLOT(onClientDisconnected()));
+    connect(client->sock, SIGNAL(bytesWritten(qint64)), this, SLOT(onClientBytesWritten()));
 
     clientList << client;
 
-    int ipCount = clientIpCount[client->sock->peerAddress().toString()];
-    clientIpCount[client->sock->peerAddress().toString()] = ipCount + 1;
-
-    qDebug("Client connected: %s:%u. There are currently %d connections from client's IP, including this one.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), ipCount + 1);
-
-    if (clientList.size() >= settings.getMaxClients()) {
-        qDebug("Maximum number of clients (%d) reached. Disconnecting client %s:%u.", settings.getMaxClients(), qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-        client->sock->disconnectFromHost();
-        return;
-    }
-
-    if (settings.getBlacklistedIps().contains(client->sock->peerAddress().toString())) {
-        qDebug("Client %s:%u is blacklisted. Disconnecting.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-        client->sock->disconnectFromHost();
-        return;
-    }
+    trafficRecorder->recordAccept(client->id, client->sock->peerAddress().toString());
 
-    int maxConnectionsFromTheSameIp = settings.getMaxSimultaneousConnectionsFromSingleIp();
-    if (maxConnectionsFromTheSameIp >= 0 && ipCount == maxConnectionsFromTheSameIp) {
-        qDebug("Client %s:%u exceeded the number of maximum simultanious connections from single IP address (%d). Disconnecting.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), maxConnectionsFromTheSameIp);
-        client->sock->disconnectFromHost();
-        return;
-    }
+    qDebug("Client connected: %s:%u. There are currently %d connections from client's IP, including this one.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), clientIpCount.value(client->sock->peerAddress().toString()));
 }
 
 void Planet::onClientDisconnected()
@@ -139,364 +621,691 @@ void Planet::onClientDisconnected()
         clientIpCount.remove(client->sock->peerAddress().toString());
     }
 
+    trafficRecorder->recordDisconnect(client->id);
+
     clientList.removeOne(client);
+    if (client->readyQueued) {
+        readyQueue.removeOne(client);
+    }
+    // the planet removes the server before dropping a client itself, so here the peer has closed the connection
     if (client->server != NULL) {
-        serverList.removeOne(client->server);
-        delete client->server;
+        if (client->server->heartbeatToken != 0) {
+            // keeps being listed for as long as heartbeats keep coming
+            qDebug("Server %s:%u is kept alive by heartbeats from now on.", qPrintable(client->server->getIp()), client->server->port);
+            client->server->client = NULL;
+            client->server->lastHeartbeat = Clock::get()->currentMSecsSinceEpoch();
+        } else {
+            removeServer(client->server);
+        }
     }
     // this slot is called by socket's signal, so we can't delete the socket directly
     client->sock->deleteLater();
     delete client;
 }
 
-void Planet::onClientReadReady()
+void Planet::getStats(Stats &stats)
+{
+    stats.uptime = uptime.elapsed();
+    stats.clients = clientList.size();
+    stats.servers = serverList.size();
+    stats.players = 0;
+    for (int i = 0; i < serverList.size(); i ++) {
+        stats.players += serverList[i]->getPlayers();
+    }
+    stats.registryVersion = registryVersion;
+    stats.heartbeatServers = heartbeatServers.size();
+    stats.compressedServerListsSent = compressedServerListsSent;
+    stats.compressedServerListRawBytes = compressedServerListRawBytes;
+    stats.compressedServerListBytes = compressedServerListBytes;
+    stats.overloadRejections = overloadRejections;
+}
+
+int Planet::getCommandCount()
+{
+    return COMMAND_COUNT;
+}
+
+char Planet::getCommand(int index)
+{
+    return COMMANDS[index].command;
+}
+
+const Planet::CommandStats &Planet::getCommandStats(int index)
+{
+    return commandStats[static_cast<uchar>(COMMANDS[index].command)];
+}
+
+void Planet::disconnectClient(Client *client, bool abort)
+{
+    // only a server whose peer closed the connection is kept alive by heartbeats. when the planet
+    // drops a client, its server goes right away, the disconnect itself may finish much later
+    if (client->server != NULL) {
+        removeServer(client->server);
+    }
+
+    if (abort) {
+        client->sock->abort();
+    } else {
+        client->sock->disconnectFromHost();
+    }
+}
+
+void Planet::banIp(const QHostAddress &address)
+{
+    settings.blacklistIp(address.toString());
+    disconnectIp(address);
+}
+
+void Planet::disconnectIp(const QHostAddress &address)
+{
+    // disconnecting might remove a client from clientList right away, so collect them first
+    QList<Client*> clients;
+    for (int i = 0; i < clientList.size(); i ++) {
+        if (clientList[i]->sock->peerAddress() == address) {
+            clients << clientList[i];
+        }
+    }
+
+    foreach (Client *client, clients) {
+        disconnectClient(client);
+    }
+
+    // servers kept alive by heartbeats have no connection to close
+    QByteArray ip = address.toString().toLatin1();
+    QList<Server*> servers;
+    foreach (Server *server, heartbeatServers) {
+        if (server->client == NULL && server->hasIp(ip.constData(), ip.size())) {
+            servers << server;
+        }
+    }
+
+    foreach (Server *server, servers) {
+        removeServer(server);
+    }
+}
+
+void Planet::removeServer(Server *server)
+{
+    serverList.removeOne(server);
+    serverIndex.remove(server);
+    prober->removeServer(server);
+    if (server->heartbeatToken != 0) {
+        heartbeatServers.remove(server->heartbeatToken);
+    }
+    if (server->client != NULL) {
+        server->client->server = NULL;
+    }
+    delete server;
+    registryVersion ++;
+}
+
+bool Planet::handleHeartbeat(const QHostAddress &address, const HeartbeatReceiver::Heartbeat &heartbeat)
+{
+    // a banned server doesn't get to stay listed through heartbeats
+    if (settings.getBlacklistedIps().contains(address.toString())) {
+        qDebug("Heartbeat from blacklisted IP %s. Dropped.", qPrintable(address.toString()));
+        return false;
+    }
+
+    Server *server = heartbeatServers.value(heartbeat.token);
+    QByteArray ip = address.toString().toLatin1();
+
+    // the token is what authenticates a heartbeat, address and port have to match as well so that a leaked token can't move a server elsewhere
+    if (server == NULL || !server->hasIp(ip.constData(), ip.size()) || server->port != heartbeat.port) {
+        qDebug("Heartbeat from %s with unknown token or for a different server. Dropped.", ip.constData());
+        return false;
+    }
+
+    server->lastHeartbeat = Clock::get()->currentMSecsSinceEpoch();
+
+    // compare with what would be stored, a name that gets cut isn't a new name every time
+    int hostnameLength = Server::truncatedLength(heartbeat.hostname, heartbeat.hostnameLength);
+    int mapnameLength = Server::truncatedLength(heartbeat.mapname, heartbeat.mapnameLength);
+
+    if (server->hostnameLength == hostnameLength && memcmp(server->hostnameData(), heartbeat.hostname, hostnameLength) == 0
+            && server->mapnameLength == mapnameLength && memcmp(server->mapnameData(), heartbeat.mapname, mapnameLength) == 0
+            && server->gametype == heartbeat.gametype && server->currentUsers == heartbeat.currentUsers && server->maxUsers == heartbeat.maxUsers) {
+        // nothing changed, which is the common case
+        return true;
+    }
+
+    serverIndex.remove(server);
+    server->setHostname(heartbeat.hostname, hostnameLength);
+    server->setMapname(heartbeat.mapname, mapnameLength);
+    server->gametype = heartbeat.gametype;
+    server->currentUsers = heartbeat.currentUsers;
+    server->maxUsers = heartbeat.maxUsers;
+    serverIndex.insert(server);
+    registryVersion ++;
+
+    qDebug("Heartbeat updated server %s:%u.", qPrintable(server->getIp()), server->port);
+    return true;
+}
+
+void Planet::onClientBytesWritten()
 {
     Client *client = sender()->property("client").value<Client*>();
 
-    char command[MAX_CLIENT_COMMAND_LENGTH];
+    if (client->sock->bytesToWrite() > settings.getMaxPendingOutputBytes()) {
+        return;
+    }
 
-    qint64 length;
+    client->overLimitSince = 0;
 
-    // read all new-line'd messages
-    while ((length = client->sock->readLine(command, MAX_CLIENT_COMMAND_LENGTH)) > 0) {
+    if (client->serverListPending) {
+        client->serverListPending = false;
+        qDebug("Client %s:%u drained its output. Sending deferred server list.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+        if (client->compressedServerListPending) {
+            sendCompressedServerList(client);
+        } else {
+            sendServerList(client);
+        }
+    }
 
-        // discard \r\n
-        length -= 2;
+    // the deferred ?G reply might have filled the output up again
+    if (client->filteredServerListPending && client->sock->bytesToWrite() <= settings.getMaxPendingOutputBytes()) {
+        client->filteredServerListPending = false;
+        ServerIndex::Filter filter;
+        // was checked when the request came in
+        parseServerListFilter(client->pendingServerListFilter.constData(), filter);
+        client->pendingServerListFilter.clear();
+        qDebug("Client %s:%u drained its output. Sending deferred filtered server list.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+        sendFilteredServerList(client, filter);
+    }
+}
 
-        command[length] = '\0';
+void Planet::onServerVisibilityChanged()
+{
+    registryVersion ++;
+}
 
-        qDebug("Command from a client %s:%u received: %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), command);
+void Planet::onLoadLevelChanged(int level, int previousLevel)
+{
+    // a warning, so that it gets through even when debug messages are being shed
+    qWarning("Event loop lag is %d ms. Load level changed from %s to %s.", loadMonitor->getLag(), LoadMonitor::getLevelName(previousLevel), LoadMonitor::getLevelName(level));
+}
 
-        if (settings.getEnablePenalty() && client->isPenaltyLimitReached()) {
-            qDebug("Client %s:%u reached penalty limit.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-            if (settings.getBlacklistIpOnMaxPointsReached()) {
-                settings.blacklistIp(client->sock->peerAddress().toString());
-                qDebug("Blacklisted IP of client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-            }
-            if (settings.getDisconnectClientOnMaxPenaltyPointsReached()) {
-                client->sock->disconnectFromHost();
-                return;
-            } else if (settings.getIgnoreClientCommandsOnMaxPenaltyPointsReached()) {
-                return;
-            }
+bool Planet::handleVersionRequest(Client *client, const char *arguments, qint64 length)
+{
+    if (length == 0) {
+        /* report V075 to old clients */
+        client->version = 75;
+        if (client->sock->write("V075\n") <= 0) {
+            qCritical("Failed to send version number to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
+        } else {
+            qDebug("Successfully sent version number to client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
         }
+        return true;
+    }
 
-        if (length < 2) {
-            qWarning("Client %s:%u sent too short command. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-            client->sock->disconnectFromHost();
-            return;
+    /* extract and save client NFK version, optionally followed by a space and the wanted extension letters */
+    QString versionString = QString(arguments);
+    QString extensionsString;
+    int space = versionString.indexOf(' ');
+    if (space != -1) {
+        extensionsString = versionString.mid(space + 1);
+        versionString.truncate(space);
+    }
+
+    bool ok;
+    client->version = versionString.toInt(&ok);
+    if (!ok) {
+        qWarning("Client %s:%u sent an invalid version number (%s). Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), arguments);
+        disconnectClient(client);
+        return false;
+    }
+
+    /* agree to the extensions we know of, ignore the rest */
+    QString acceptedExtensions;
+    client->extensions = 0;
+    for (int i = 0; PLANET_EXTENSIONS[i] != '\0'; i ++) {
+        if ((enabledExtensions & (1 << i)) && extensionsString.contains(PLANET_EXTENSIONS[i])) {
+            client->extensions |= 1 << i;
+            acceptedExtensions.append(PLANET_EXTENSIONS[i]);
         }
+    }
 
-        if (command[0] != '?') {
-            qWarning("Client %s:%u sent invalid command first byte. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-            client->sock->disconnectFromHost();
-            return;
+    /* report current Planet version, old clients never ask for extensions so they get the reply they expect */
+    QString versionReply = space == -1 ? QString("V%1\n").arg(PLANET_VERSION) : QString("V%1 %2\n").arg(PLANET_VERSION).arg(acceptedExtensions);
+    if (client->sock->write(versionReply.toAscii().data()) <= 0) {
+        qCritical("Failed to send version number to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
+    } else {
+        qDebug("Successfully sent version number to client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+    }
+    return true;
+}
+
+bool Planet::handleServerListRequest(Client *client, const char *, qint64)
+{
+    if (client->version < version) {
+        /* send the message to old clients */
+        if (client->sock->write(OLD_VERSION_MESSAGE, sizeof(OLD_VERSION_MESSAGE) - 1) != sizeof(OLD_VERSION_MESSAGE) - 1) {
+            qCritical("Failed to send the old version message to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
+        } else {
+            qDebug("Successfully sent the old version message to client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
         }
+    } else if (!deferServerList(client, false)) {
+        sendServerList(client);
+    }
+    return true;
+}
 
-        /* client must ask for Planet version first (since 077 client also reports its version) */
-        if (client->version == 0 && command[1] != 'V') {
-            qWarning("Client %s:%u did not provide its version first. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-            client->sock->disconnectFromHost();
-            return;
+bool Planet::handleCompressedServerListRequest(Client *client, const char *, qint64)
+{
+    if (!deferServerList(client, true)) {
+        sendCompressedServerList(client);
+    }
+    return true;
+}
+
+bool Planet::handleFilteredServerListRequest(Client *client, const char *arguments, qint64)
+{
+    ServerIndex::Filter filter;
+    if (!parseServerListFilter(arguments, filter)) {
+        qWarning("Client %s:%u has sent an invalid server list filter (%s). Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), arguments);
+        disconnectClient(client);
+        return false;
+    }
+
+    if (client->sock->bytesToWrite() > settings.getMaxPendingOutputBytes()) {
+        /* like deferServerList(), the previous reply hasn't drained yet */
+        client->filteredServerListPending = true;
+        client->pendingServerListFilter = QByteArray(arguments);
+        if (client->overLimitSince == 0) {
+            client->overLimitSince = Clock::get()->currentMSecsSinceEpoch();
         }
+        qDebug("Client %s:%u is over its output limit (%lld bytes pending). Filtered server list request deferred.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), client->sock->bytesToWrite());
+        return true;
+    }
 
-        switch (command[1]) {
-            case 'V': {   /* version request */
-                if (settings.getEnablePenalty()) {
-                    client->addPenalty(settings.getVersionRequestPenalty());
-                }
+    sendFilteredServerList(client, filter);
+    return true;
+}
 
-                if (length == 2) {
-                    /* report V075 to old clients */
-                    client->version = 75;
-                    if (client->sock->write("V075\n") <= 0) {
-                        qCritical("Failed to send version number to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
-                    } else {
-                        qDebug("Successfully sent version number to client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                    }
-                } else {
-                    /* extract and save client NFK version */
-                    bool ok;
-                    client->version = QString(command + 2).toInt(&ok);
-                    if (!ok) {
-                        qWarning("Client %s:%u sent an invalid version number (%s). Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), command + 2);
-                        client->sock->disconnectFromHost();
-                        return;
-                    }
-                    /* report current Planet version */
-                    if (client->sock->write(QString("V%1\n").arg(PLANET_VERSION).toAscii().data()) <= 0) {
-                        qCritical("Failed to send version number to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
-                    } else {
-                        qDebug("Successfully sent version number to client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                    }
-                }
-                break;
-            }
-            case 'G': {  /* servers list request */
-                if (settings.getEnablePenalty()) {
-                    client->addPenalty(settings.getServerListRequestPenalty());
-                }
+void Planet::sendFilteredServerList(Client *client, const ServerIndex::Filter &filter)
+{
+    QList<Server*> page;
+    bool hasMore = serverIndex.query(filter, page);
 
-                if (client->version < QString(PLANET_VERSION).toInt()) {
-                    /* send the message to old clients */
-                    if (client->sock->write(OLD_VERSION_MESSAGE, sizeof(OLD_VERSION_MESSAGE) - 1) != sizeof(OLD_VERSION_MESSAGE) - 1) {
-                        qCritical("Failed to send the old version message to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
-                    } else {
-                        qDebug("Successfully sent the old version message to client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                    }
-                } else {
-                    QByteArray servers;
-                    qint64 serversSize = 0;
-                    // value from the original nfkplanet
-                    servers.reserve(90 * serverList.size() + 3);
-
-                    for (int i = 0; i < serverList.size(); i ++) {
-                        Server *server = serverList[i];
-
-                        QString serverEntry = QString("L%1\r%2\r%3\r%4\r%5\r%6\r")
-                                .arg(server->client->sock->peerAddress().toString())
-                                .arg(server->hostname)
-                                .arg(server->mapname)
-                                .arg(server->gametype)
-                                .arg(server->currentUsers)
-                                .arg(server->maxUsers);
-
-                        if (client->version > 76) {
-                            serverEntry.append(QString("%1\r")
-                                        .arg(server->port));
-                        }
-
-                        serverEntry.append("\n");
-
-                        servers.append(serverEntry);
-                        servers.append('\0');
-                        serversSize += serverEntry.size() + 1;
-                    }
-
-                    servers.append("E\n\0");
-                    serversSize += 3;
-
-                    if (client->sock->write(servers.data(), serversSize) != serversSize) {
-                        qCritical("Failed to send server list to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
-                    } else {
-                        qDebug("Successfully sent server list to client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                    }
-                }
-                break;
+    QByteArray servers;
+    servers.reserve(90 * page.size() + 16);
+
+    for (int i = 0; i < page.size(); i ++) {
+        appendServerEntry(servers, page[i], true, true);
+    }
+
+    /* tell the client where to continue from if the page is not the last one */
+    if (hasMore && !page.isEmpty()) {
+        servers.append(QString("c%1\n").arg(page.last()->id));
+        servers.append('\0');
+    }
+
+    servers.append("E\n", 2);
+    servers.append('\0');
+
+    if (client->sock->write(servers) != servers.size()) {
+        qCritical("Failed to send filtered server list to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
+    } else {
+        qDebug("Successfully sent filtered server list (%d servers) to client %s:%u.", page.size(), qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+    }
+
+    if (client->overLimitSince == 0 && client->sock->bytesToWrite() > settings.getMaxPendingOutputBytes()) {
+        client->overLimitSince = Clock::get()->currentMSecsSinceEpoch();
+    }
+}
+
+bool Planet::handleServerRegistration(Client *client, const char *arguments, qint64)
+{
+    if (client->server != NULL) {
+        qWarning("Client %s:%u tried to register server twice. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+        disconnectClient(client);
+        return false;
+    }
+
+    bool ok;
+    quint16 port = QString(arguments).toShort(&ok);
+    if (!ok) {
+        qWarning("Client %s:%u has sent invalid port (%s). Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), arguments);
+        disconnectClient(client);
+        return false;
+    }
+
+    QByteArray ip = client->sock->peerAddress().toString().toLatin1();
+
+    for (int i = 0; i < serverList.size(); i ++) {
+        Server* server = serverList[i];
+        if (server->hasIp(ip.constData(), ip.size()) && server->port == port) {
+            qDebug("Client %s:%u tried to create server twice. Removed the first server and disconnecting its client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+            if (server->client != NULL) {
+                disconnectClient(server->client);
+            } else {
+                // kept alive by heartbeats, there is no connection to close
+                removeServer(server);
             }
-            case 'R': {   /* register new server */
-                if (settings.getEnablePenalty()) {
-                    client->addPenalty(settings.getServerRegistrationPenalty());
-                }
+            break;
+        }
+    }
 
-                if (client->server != NULL) {
-                    qWarning("Client %s:%u tried to register server twice. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                    client->sock->disconnectFromHost();
-                    return;
-                }
+    Server *newServer = new Server();
+
+    client->server = newServer;
+    newServer->id = ++ lastServerId;
+    newServer->client = client;
+    newServer->port = port;
+    newServer->ipv4 = client->ipv4;
+    newServer->setIp(ip.constData(), ip.size());
+    newServer->setHostname("null", 4);
+    newServer->setMapname("null", 4);
+    newServer->currentUsers = '0';
+    newServer->maxUsers = '8';
+    newServer->gametype = '0';
+
+    serverList << newServer;
+    prober->addServer(newServer);
+    serverIndex.insert(newServer);
+    registryVersion ++;
+
+    qDebug("Client %s:%u created a server %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->peerAddress().toString()), client->server->port);
+
+    if (client->sock->write("r\n") <= 0) {
+        qCritical("Failed to send server registration confirmation to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
+    } else {
+        qDebug("Successfully sent server registration confirmation to client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+    }
+    return true;
+}
 
-                /* don't let old clients create servers, drop them instead */
-                if (client->version < 76) {
-                    qWarning("Client %s:%u with an old version (%d) tried to register a server. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), client->version);
-                    client->sock->disconnectFromHost();
-                    return;
-                }
+bool Planet::handleSetServerName(Client *client, const char *arguments, qint64 length)
+{
+    client->server->setHostname(arguments, length);
+    registryVersion ++;
 
-                Server *newServer = new Server();
+    qDebug("Client %s:%u set server name of server %s:%u to \"%s\".", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->peerAddress().toString()), client->server->port, qPrintable(client->server->getHostname()));
+    return true;
+}
 
-                bool ok;
-                newServer->port = QString(command + 2).toShort(&ok);
-                if (!ok) {
-                    qWarning("Client %s:%u has sent invalid port (%s). Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), command + 2);
-                    client->sock->disconnectFromHost();
-                    return;
-                }
+bool Planet::handleSetServerMap(Client *client, const char *arguments, qint64 length)
+{
+    serverIndex.remove(client->server);
+    client->server->setMapname(arguments, length);
+    serverIndex.insert(client->server);
+    registryVersion ++;
 
-                QMutableListIterator<Server*> it(serverList);
-                while (it.hasNext()) {
-                    Server* server = it.next();
-                    if (server->client->sock->peerAddress().toString().compare(client->sock->peerAddress().toString(), Qt::CaseInsensitive) == 0 && server->port == newServer->port) {
-                        qDebug("Client %s:%u tried to create server twice. Removed the first server and disconnecting its client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                        server->client->sock->disconnectFromHost();
-                        break;
-                    }
-                }
+    qDebug("Client %s:%u set server map name of server %s:%u to \"%s\".", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->peerAddress().toString()), client->server->port, qPrintable(client->server->getMapname()));
+    return true;
+}
 
-                client->server = newServer;
-                newServer->client = client;
-                newServer->hostname = "null";
-                newServer->mapname = "null";
-                newServer->currentUsers = '0';
-                newServer->maxUsers = '8';
-                newServer->gametype = '0';
+bool Planet::handleSetPlayersCount(Client *client, const char *arguments, qint64)
+{
+    serverIndex.remove(client->server);
+    client->server->currentUsers = arguments[0];
+    serverIndex.insert(client->server);
+    registryVersion ++;
 
-                serverList << newServer;
+    qDebug("Client %s:%u set server current player count of server %s:%u to %c.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->peerAddress().toString()), client->server->port, client->server->currentUsers);
+    return true;
+}
 
-                qDebug("Client %s:%u created a server %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->peerAddress().toString()), client->server->port);
+bool Planet::handleSetMaxPlayersCount(Client *client, const char *arguments, qint64)
+{
+    serverIndex.remove(client->server);
+    client->server->maxUsers = arguments[0];
+    serverIndex.insert(client->server);
+    registryVersion ++;
 
-                if (client->sock->write("r\n") <= 0) {
-                    qCritical("Failed to send server registration confirmation to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
-                } else {
-                    qDebug("Successfully sent server registration confirmation to client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                }
+    qDebug("Client %s:%u set server maximum player count of server %s:%u to %c.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->peerAddress().toString()), client->server->port, client->server->maxUsers);
+    return true;
+}
 
-                break;
-            }
-            case 'N': {   /* set server name */
-                if (settings.getEnablePenalty()) {
-                    client->addPenalty(settings.getSetServerNamePenalty());
-                }
+bool Planet::handleSetGameType(Client *client, const char *arguments, qint64)
+{
+    serverIndex.remove(client->server);
+    client->server->gametype = arguments[0];
+    serverIndex.insert(client->server);
+    registryVersion ++;
 
-                if (client->server == NULL) {
-                    qWarning("Client %s:%u has tried to set server name without having a server created. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                    client->sock->disconnectFromHost();
-                    return;
-                }
+    qDebug("Client %s:%u set server gametype of server %s:%u to %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->peerAddress().toString()), client->server->port, qPrintable(client->server->getGametypeString()));
+    return true;
+}
 
-                client->server->hostname = QString(command + 2);
+bool Planet::handleNumberOfClientsRequest(Client *client, const char *, qint64)
+{
+    if (client->sock->write(QString("S%1\n").arg(clientList.size()).toAscii().data()) <= 0) {
+        qCritical("Failed to send planet's' number of connected clients to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
+    } else {
+        qDebug("Successfully sent planet's' number of connected clients (%d) to client %s:%u.", clientList.size(), qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+    }
+    return true;
+}
 
-                qDebug("Client %s:%u set server name of server %s:%u to \"%s\".", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->peerAddress().toString()), client->server->port, qPrintable(client->server->hostname));
+bool Planet::handlePing(Client *client, const char *, qint64)
+{
+    client->lastPinged = Clock::get()->currentMSecsSinceEpoch();
 
-                break;
-            }
-            case 'm': {  /* set server map */
-                if (settings.getEnablePenalty()) {
-                    client->addPenalty(settings.getSetServerMapPenalty());
-                }
+    if (client->sock->write("K\n") <= 0) {
+        qCritical("Failed to send a ping reply to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
+    } else {
+        qDebug("Successfully sent a ping reply to client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+    }
+    return true;
+}
 
-                if (client->server == NULL) {
-                    qWarning("Client %s:%u has tried to set server map name without having a server created. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                    client->sock->disconnectFromHost();
-                    return;
-                }
+bool Planet::handleInviteRequest(Client *client, const char *arguments, qint64)
+{
+    QStringList serverIpPort = QString(arguments).split(':');
 
-                client->server->mapname = QString(command + 2);
+    if (serverIpPort.size() != 2) {
+        qWarning("Client %s:%u has sent invalid invite ip:port (%s). Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), arguments);
+        disconnectClient(client);
+        return false;
+    }
 
-                qDebug("Client %s:%u set server map name of server %s:%u to \"%s\".", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->peerAddress().toString()), client->server->port, qPrintable(client->server->mapname));
+    QString serverIp = serverIpPort[0];
+    QByteArray serverIpBytes = serverIp.toLatin1();
 
-                break;
+    bool ok;
+    quint16 serverPort = serverIpPort[1].toShort(&ok);
+    if (!ok) {
+        qWarning("Client %s:%u has sent invalid port (%s). Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(serverIpPort[1]));
+        disconnectClient(client);
+        return false;
+    }
+
+    for (int i = 0; i < serverList.size(); i ++) {
+        Server *server = serverList[i];
+        if (server->hasIp(serverIpBytes.constData(), serverIpBytes.size()) && server->port == serverPort) {
+
+            if (client->sock->write((QString("x%1\n").arg(serverIp)).toAscii().data()) <= 0) {
+                qCritical("Failed to rely an invitation request from client %s:%u to server %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(server->getIp()), server->port, qPrintable(client->sock->errorString()));
+            } else {
+                qDebug("Successfully relied an invitation request from client %s:%u to server %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(server->getIp()), server->port);
             }
-            case 'C': {  /* set players count */
-                if (settings.getEnablePenalty()) {
-                    client->addPenalty(settings.getSetPlayersCountPenalty());
-                }
 
-                if (client->server == NULL) {
-                    qWarning("Client %s:%u has tried to set current player count without having a server created. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                    client->sock->disconnectFromHost();
-                    return;
-                }
+            break;
+        }
+    }
+    return true;
+}
 
-                client->server->currentUsers = command[2];
+bool Planet::handleHeartbeatTokenRequest(Client *client, const char *, qint64)
+{
+    Server *server = client->server;
 
-                qDebug("Client %s:%u set server current player count of server %s:%u to %c.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->peerAddress().toString()), client->server->port, client->server->currentUsers);
+    // a new token replaces the old one
+    if (server->heartbeatToken != 0) {
+        heartbeatServers.remove(server->heartbeatToken);
+    }
+    do {
+        server->heartbeatToken = HeartbeatReceiver::generateToken();
+    } while (heartbeatServers.contains(server->heartbeatToken));
+    heartbeatServers.insert(server->heartbeatToken, server);
+
+    QByteArray reply = QString("T%1 %2\n").arg(server->heartbeatToken, 16, 16, QChar('0')).arg(heartbeatReceiver->getPort()).toAscii();
+    if (client->sock->write(reply) != reply.size()) {
+        qCritical("Failed to send a heartbeat token to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
+    } else {
+        qDebug("Successfully sent a heartbeat token for server %s:%u to client %s:%u.", qPrintable(server->getIp()), server->port, qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+    }
+    return true;
+}
 
-                break;
-            }
-            case 'M': {  /* set max players count */
-                if (settings.getEnablePenalty()) {
-                    client->addPenalty(settings.getSetMaxPlayersCountPenalty());
-                }
+void Planet::onClientReadReady()
+{
+    Client *client = sender()->property("client").value<Client*>();
 
-                if (client->server == NULL) {
-                    qWarning("Client %s:%u has tried to set server maximum player count without having a server created. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                    client->sock->disconnectFromHost();
-                    return;
-                }
+    // it will get to the new input when its turn comes, no jumping the queue
+    if (client->readyQueued) {
+        return;
+    }
 
-                client->server->maxUsers= command[2];
+    processCommands(client);
+}
 
-                qDebug("Client %s:%u set server maximum player count of server %s:%u to %c.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->peerAddress().toString()), client->server->port, client->server->maxUsers);
+void Planet::onReadyQueue()
+{
+    // one round, clients that still have input left after their turn go to the back of the queue for the next one
+    for (int turns = readyQueue.size(); turns > 0 && !readyQueue.isEmpty(); turns --) {
+        Client *client = readyQueue.dequeue();
+        client->readyQueued = false;
+        processCommands(client);
+    }
 
-                break;
-            }
-            case 'P': {  /* set server game type */
-                if (settings.getEnablePenalty()) {
-                    client->addPenalty(settings.getSetGameTypePenalty());
-                }
+    // let everything else that is waiting in the event loop run before the next round
+    if (!readyQueue.isEmpty()) {
+        readyQueueTimer->start();
+    }
+}
 
-                if (client->server == NULL) {
-                    qWarning("Client %s:%u has tried to set server game type without having a server created. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                    client->sock->disconnectFromHost();
-                    return;
-                }
+void Planet::processCommands(Client *client)
+{
+    char command[MAX_CLIENT_COMMAND_LENGTH];
 
-                client->server->gametype = command[2];
+    qint64 length;
 
-                qDebug("Client %s:%u set server gametype of server %s:%u to %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->peerAddress().toString()), client->server->port, qPrintable(client->server->getGametypeString()));
+    // 0 or less means no limit
+    int budget = settings.getCommandsPerTurn();
 
-                break;
-            }
-            case 'S': {  /* get number of clients */
-                if (settings.getEnablePenalty()) {
-                    client->addPenalty(settings.getNumberOfClientsRequestPenalty());
-                }
+    // read new-line'd messages, as many as the budget allows
+    for (int handled = 0; budget <= 0 || handled < budget; handled ++) {
+        length = client->sock->readLine(command, MAX_CLIENT_COMMAND_LENGTH);
+        if (length <= 0) {
+            return;
+        }
 
-                if (client->sock->write(QString("S%1\n").arg(clientList.size()).toAscii().data()) <= 0) {
-                    qCritical("Failed to send planet's' number of connected clients to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
-                } else {
-                    qDebug("Successfully sent planet's' number of connected clients (%d) to client %s:%u.", clientList.size(), qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                }
-                break;
-            }
-            case 'K': {  /* ping */
-                if (settings.getEnablePenalty()) {
-                    client->addPenalty(settings.getPingRequestPenalty());
-                }
+        trafficRecorder->recordData(client->id, command, length);
+
+        // discard \r\n
+        length -= 2;
 
-                client->lastPinged = QDateTime::currentMSecsSinceEpoch();
+        command[length] = '\0';
 
-                if (client->sock->write(QString("K\n").toAscii().data()) <= 0) {
-                    qCritical("Failed to send a ping reply to client %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(client->sock->errorString()));
-                } else {
-                    qDebug("Successfully sent a ping reply to client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                }
+        // record before validating anything, so that whatever garbage a client sends shows up in the recorder too
+        qint64 time = uptime.elapsed();
+        char commandByte = length >= 2 ? command[1] : '\0';
+        FlightRecorder::Event *event = client->events.record(time, client->id, commandByte, qMax(length, qint64(0)), client->getPenaltyPoints());
+        FlightRecorder::Event *globalEvent = globalEvents.record(time, client->id, commandByte, qMax(length, qint64(0)), client->getPenaltyPoints());
+        qint64 pendingOutput = client->sock->bytesToWrite();
 
-                break;
+        qDebug("Command from a client %s:%u received: %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), command);
+
+        if (settings.getEnablePenalty() && client->isPenaltyLimitReached()) {
+            qDebug("Client %s:%u reached penalty limit.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+            if (settings.getBlacklistIpOnMaxPointsReached()) {
+                settings.blacklistIp(client->sock->peerAddress().toString());
+                qDebug("Blacklisted IP of client %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
             }
-            case 'X': {  /* ask for invite */
-                if (settings.getEnablePenalty()) {
-                    client->addPenalty(settings.getInviteRequestPenalty());
-                }
+            if (settings.getDisconnectClientOnMaxPenaltyPointsReached()) {
+                disconnectClient(client);
+                return;
+            } else if (settings.getIgnoreClientCommandsOnMaxPenaltyPointsReached()) {
+                return;
+            }
+        }
 
-                QStringList serverIpPort = QString(command + 2).split(':');
+        if (length < 2) {
+            qWarning("Client %s:%u sent too short command. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+            disconnectClient(client);
+            return;
+        }
 
-                if (serverIpPort.size() != 2) {
-                    qWarning("Client %s:%u has sent invalid invite ip:port (%s). Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), command + 2);
-                    client->sock->disconnectFromHost();
-                    return;
-                }
+        if (command[0] != '?') {
+            qWarning("Client %s:%u sent invalid command first byte. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+            disconnectClient(client);
+            return;
+        }
 
-                QString serverIp = serverIpPort[0];
+        const Command *descriptor = commandTable[static_cast<uchar>(commandByte)];
+
+        if (descriptor == NULL) {
+            qWarning("Client %s:%u has sent an unknown command. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+            disconnectClient(client);
+            return;
+        }
 
-                bool ok;
-                quint16 serverPort = serverIpPort[1].toShort(&ok);
-                if (!ok) {
-                    qWarning("Client %s:%u has sent invalid port (%s). Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(serverIpPort[0]));
-                    client->sock->disconnectFromHost();
+        int penalty = 0;
+        if (settings.getEnablePenalty()) {
+            penalty = (settings.*descriptor->penalty)();
+            if (loadMonitor->getLevel() != LoadMonitor::Normal) {
+                penalty *= settings.getDegradedPenaltyMultiplier();
+            }
+            client->addPenalty(penalty);
+            event->penaltyPoints = globalEvent->penaltyPoints = client->getPenaltyPoints();
+
+            if (abuseDetector->addPenalty(client->ipv4, penalty)) {
+                qWarning("IP of client %s:%u is sending too many commands across all of its connections.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+                if (settings.getAbuseBlacklistHotIps()) {
+                    qDebug("Blacklisting IP of client %s:%u. Disconnecting all of its connections.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+                    banIp(client->sock->peerAddress());
                     return;
                 }
+            }
+        }
 
-                for (int i = 0; i < serverList.size(); i ++) {
-                    Server *server = serverList[i];
-                    if (server->client->sock->peerAddress().toString().compare(serverIp, Qt::CaseInsensitive) == 0 && server->port == serverPort) {
+        CommandStats &stats = commandStats[static_cast<uchar>(commandByte)];
+        stats.count ++;
+        stats.penaltyPoints += penalty;
 
-                        if (client->sock->write((QString("x%1\n").arg(serverIp)).toAscii().data()) <= 0) {
-                            qCritical("Failed to rely an invitation request from client %s:%u to server %s:%u. %s.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(server->client->sock->peerAddress().toString()), server->port, qPrintable(client->sock->errorString()));
-                        } else {
-                            qDebug("Successfully relied an invitation request from client %s:%u to server %s:%u.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), qPrintable(server->client->sock->peerAddress().toString()), server->port);
-                        }
+        /* client must ask for Planet version first (since 077 client also reports its version) */
+        if (client->version == 0 && descriptor->minVersion > 0) {
+            qWarning("Client %s:%u did not provide its version first. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
+            disconnectClient(client);
+            return;
+        }
 
-                        break;
-                    }
-                }
-            }
-            default: {
-                qWarning("Client %s:%u has sent an unknown command. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort());
-                client->sock->disconnectFromHost();
-                break;
-            }
+        if (client->version < descriptor->minVersion) {
+            qWarning("Client %s:%u with an old version (%d) tried to %s. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), client->version, descriptor->description);
+            disconnectClient(client);
+            return;
+        }
+
+        if ((client->extensions & descriptor->extension) != descriptor->extension) {
+            qWarning("Client %s:%u tried to %s without negotiating it first. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), descriptor->description);
+            disconnectClient(client);
+            return;
+        }
+
+        if (descriptor->serverRequired && client->server == NULL) {
+            qWarning("Client %s:%u has tried to %s without having a server created. Command dropped. Disconnecting the client.", qPrintable(client->sock->peerAddress().toString()), client->sock->peerPort(), descriptor->description);
+            disconnectClient(client);
+            return;
         }
 
+        if (!(this->*descriptor->handler)(client, command + 2, length - 2)) {
+            return;
+        }
+
+        qint64 replySize = client->sock->bytesToWrite() - pendingOutput;
+        stats.replyBytes += replySize;
+
+        event->replySize = globalEvent->replySize = replySize;
+    }
+
+    // out of budget, the rest of the input waits for the client's next turn
+    if (client->sock->bytesAvailable() > 0) {
+        client->readyQueued = true;
+        readyQueue.enqueue(client);
+        if (!readyQueueTimer->isActive()) {
+            readyQueueTimer->start();
+        }
     }
 }
@@ -24,33 +24,171 @@
 #ifndef PLANET_H
 #define PLANET_H
 
+#include <QElapsedTimer>
 #include <QMutex>
 #include <QObject>
 #include <QHash>
+#include <QQueue>
+#include "flightrecorder.h"
+#include "heartbeatreceiver.h"
+#include "serverindex.h"
 #include "settings.h"
 
 class QTimer;
 class Client;
+class AbuseDetector;
+class AdminServer;
+class HttpExport;
+class LoadMonitor;
+class Prober;
+class StatsHistory;
+class TrafficRecorder;
+class QSocketNotifier;
 class Server;
-class QTcpServer;
+class Acceptor;
+class Transport;
+class QHostAddress;
 
 class Planet : public QObject
 {
     Q_OBJECT
 public:
+    // counters of a protocol command
+    struct CommandStats {
+        quint64 count;
+        quint64 penaltyPoints;
+        quint64 replyBytes;
+    };
+
+    // planet-wide counters, filled in by getStats()
+    struct Stats {
+        qint64 uptime;
+        int clients;
+        int servers;
+        int players;
+        quint64 registryVersion;
+        // servers that were given a heartbeat token
+        int heartbeatServers;
+        // compressed server list replies sent, their size before and after compression
+        quint64 compressedServerListsSent;
+        quint64 compressedServerListRawBytes;
+        quint64 compressedServerListBytes;
+        // connections rejected because the planet was overloaded
+        quint64 overloadRejections;
+    };
+
     Planet();
 
     void start(QString address, quint16 port);
 
+    // called for every accepted connection before anything is set up for it
+    bool admitConnection(const QHostAddress &address);
+    // undoes admitConnection() for a connection that couldn't be set up after all
+    void withdrawAdmission(const QHostAddress &address);
+    // sets up a client for an admitted connection
+    void addConnection(Transport *transport);
+
+    // writes the recorded protocol events of all clients, or of a single one, to a file
+    bool dumpFlightRecorder(const QString &filePath, Client *onlyClient = NULL);
+
+    // returns false if the heartbeat was rejected
+    bool handleHeartbeat(const QHostAddress &address, const HeartbeatReceiver::Heartbeat &heartbeat);
+
+    const QList<Client*> &getClients() {return clientList;}
+    const QList<Server*> &getServers() {return serverList;}
+    // changes whenever the server list or any of the servers in it change
+    quint64 getRegistryVersion() {return registryVersion;}
+
+    void getStats(Stats &stats);
+    // protocol commands in the order they are always listed in, and their counters
+    static int getCommandCount();
+    static char getCommand(int index);
+    const CommandStats &getCommandStats(int index);
+
+    AbuseDetector *getAbuseDetector() {return abuseDetector;}
+    HeartbeatReceiver *getHeartbeatReceiver() {return heartbeatReceiver;}
+    LoadMonitor *getLoadMonitor() {return loadMonitor;}
+    StatsHistory *getStatsHistory() {return statsHistory;}
+
+    // a server registered by the client is removed right away, rather than kept alive by heartbeats
+    void disconnectClient(Client *client, bool abort = false);
+    // blacklists the address and disconnects all of its clients
+    void banIp(const QHostAddress &address);
+
 private:
     QTimer *pingCheckTimer;
-    QTcpServer *server;
+    Acceptor *server;
+    Prober *prober;
+    TrafficRecorder *trafficRecorder;
+    AbuseDetector *abuseDetector;
+    AdminServer *adminServer;
+    HttpExport *httpExport;
+    HeartbeatReceiver *heartbeatReceiver;
+    StatsHistory *statsHistory;
+    LoadMonitor *loadMonitor;
 
     QList<Client*> clientList;
     QList<Server*> serverList;
+    // includes admitted connections that haven't been picked up by onClientConnect() yet
     QHash<QString, int> clientIpCount;
+    int admittedConnections;
+    quint32 lastClientId;
+
+    // clients that ran out of their command budget with input left, served round-robin a turn at a time
+    QQueue<Client*> readyQueue;
+    QTimer *readyQueueTimer;
+
+    QElapsedTimer uptime;
+    // last protocol events of all clients
+    FlightRecorder::Ring<4096> globalEvents;
+
+    // SIGUSR1 dumps the flight recorder. signal handler just writes to a socket pair, which is then handled in the event loop
+    static int sigusr1Fd[2];
+    static void sigusr1Handler(int);
+    QSocketNotifier *sigusr1Notifier;
+
+    // bumped on every change to serverList or to any of its servers
+    quint64 registryVersion;
+    // server list replies for clients with and without port support, formatted once for all requesters.
+    // writing one still copies it into the client's own socket buffer, so a client holds at most
+    // maxPendingOutputBytes plus one list of pending output, deferServerList() sees to that
+    QByteArray serverListCache[2];
+    quint64 serverListCacheVersion[2];
+    // uptime when the cache was last rebuilt. under load the cache is served stale for a while
+    qint64 serverListCacheTime[2];
+    // deflated copy of serverListCache[1], rebuilt only when the plain one is
+    QByteArray compressedServerListCache;
+    quint64 compressedServerListCacheVersion;
+    // compressed server list replies sent, their size before and after compression
+    quint64 compressedServerListsSent;
+    quint64 compressedServerListRawBytes;
+    quint64 compressedServerListBytes;
+    // connections rejected because the planet was overloaded
+    quint64 overloadRejections;
+
+    ServerIndex serverIndex;
+    quint32 lastServerId;
+
+    // servers that were given a heartbeat token, by their token
+    QHash<quint64, Server*> heartbeatServers;
+    // Client::Extension flags the planet agrees to, some depend on the settings
+    int enabledExtensions;
+
+    static void appendServerEntry(QByteArray &servers, Server *server, bool withPorts, bool withLatency = false);
+    const QByteArray &getServerList(bool withPorts);
+    void sendServerList(Client *client);
+    const QByteArray &getCompressedServerList();
+    void sendCompressedServerList(Client *client);
+    bool deferServerList(Client *client, bool compressed);
+    void sendFilteredServerList(Client *client, const ServerIndex::Filter &filter);
+    bool parseServerListFilter(const char *filter, ServerIndex::Filter &result);
+    void disconnectIp(const QHostAddress &address);
+    void removeServer(Server *server);
+    void processCommands(Client *client);
 
     static const char PLANET_VERSION[];
+    // letters of the protocol extensions the planet supports, in Client::Extension order
+    static const char PLANET_EXTENSIONS[];
 
     // original had 600*1000, i.e. 600 seconds or 10 minutes
     // it's a long time, considering a client pings about every 60 seconds
@@ -67,11 +205,55 @@ private:
 
     Settings &settings;
 
+    // command handlers return false if the client got disconnected and no more of its commands should be processed
+    typedef bool (Planet::*CommandHandler)(Client *client, const char *arguments, qint64 length);
+
+    struct Command {
+        char command;
+        CommandHandler handler;
+        int (Settings::*penalty)();
+        // clients with older versions get disconnected. any non-zero version requires a version request first
+        int minVersion;
+        // Client::Extension flags that must have been negotiated
+        int extension;
+        // command modifies client's server, so the client must have registered one
+        bool serverRequired;
+        // used in log messages, as in "client tried to <description>"
+        const char *description;
+    };
+
+    static const Command COMMANDS[];
+    // COMMANDS is incomplete outside of planet.cpp, so its size can't be taken elsewhere
+    static const int COMMAND_COUNT;
+    // COMMANDS indexed by the command byte, NULL for unknown commands
+    const Command *commandTable[256];
+    CommandStats commandStats[256];
+
+    bool handleVersionRequest(Client *client, const char *arguments, qint64 length);
+    bool handleServerListRequest(Client *client, const char *arguments, qint64 length);
+    bool handleFilteredServerListRequest(Client *client, const char *arguments, qint64 length);
+    bool handleServerRegistration(Client *client, const char *arguments, qint64 length);
+    bool handleSetServerName(Client *client, const char *arguments, qint64 length);
+    bool handleSetServerMap(Client *client, const char *arguments, qint64 length);
+    bool handleSetPlayersCount(Client *client, const char *arguments, qint64 length);
+    bool handleSetMaxPlayersCount(Client *client, const char *arguments, qint64 length);
+    bool handleSetGameType(Client *client, const char *arguments, qint64 length);
+    bool handleNumberOfClientsRequest(Client *client, const char *arguments, qint64 length);
+    bool handlePing(Client *client, const char *arguments, qint64 length);
+    bool handleInviteRequest(Client *client, const char *arguments, qint64 length);
+    bool handleHeartbeatTokenRequest(Client *client, const char *arguments, qint64 length);
+    bool handleCompressedServerListRequest(Client *client, const char *arguments, qint64 length);
+
 private slots:
     void onPingCheck();
     void onClientConnect();
     void onClientDisconnected();
+    void onClientBytesWritten();
+    void onServerVisibilityChanged();
+    void onLoadLevelChanged(int level, int previousLevel);
+    void onSigusr1();
     void onClientReadReady();
+    void onReadyQueue();
 
 };
 
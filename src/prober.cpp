@@ -0,0 +1,207 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "client.h"
+#include "clock.h"
+#include "prober.h"
+#include "server.h"
+#include "settings.h"
+
+#include <QHostAddress>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUdpSocket>
+
+// NFK doesn't answer it, only a cooperating responder does. any answer at all shows that the server is alive
+static const char PROBE_DATAGRAM[] = "\n";
+
+Prober::Prober(QObject *parent) : QObject(parent), settings(Settings::getInstance())
+{
+    tickTimer = new QTimer(this);
+    tickTimer->setInterval(settings.getProbeTickMilliseconds());
+    connect(tickTimer, SIGNAL(timeout()), this, SLOT(onTick()));
+
+    udp = settings.getProbeProtocol().compare("udp", Qt::CaseInsensitive) == 0;
+}
+
+void Prober::start()
+{
+    if (!settings.getEnableProber()) {
+        return;
+    }
+
+    qsrand(Clock::get()->currentMSecsSinceEpoch());
+    tickTimer->start();
+}
+
+void Prober::addServer(Server *server)
+{
+    server->latency = -1;
+    server->probeFailures = 0;
+    server->hidden = false;
+
+    if (!settings.getEnableProber()) {
+        return;
+    }
+
+    // spread the first probes over the whole interval, so that a burst of registrations doesn't turn into a burst of probes
+    scheduleProbe(server, Clock::get()->currentMSecsSinceEpoch(), settings.getProbeIntervalSeconds() * 1000);
+}
+
+void Prober::removeServer(Server *server)
+{
+    schedule.remove(server->nextProbeTime, server);
+
+    QAbstractSocket *socket = inFlightServers.take(server);
+    if (socket != NULL) {
+        inFlight.remove(socket);
+        socket->disconnect(this);
+        socket->abort();
+        socket->deleteLater();
+    }
+}
+
+void Prober::scheduleProbe(Server *server, qint64 currentTime, qint64 interval)
+{
+    // jitter the interval, so that servers registered at the same time get probed at different times
+    qint64 jitter = interval * settings.getProbeJitterPercent() / 100;
+    qint64 delay = interval;
+    if (jitter > 0) {
+        delay += qrand() % (2 * jitter + 1) - jitter;
+    }
+
+    server->nextProbeTime = currentTime + qMax(delay, qint64(0));
+    schedule.insert(server->nextProbeTime, server);
+}
+
+void Prober::launchProbe(Server *server, qint64 currentTime)
+{
+    QAbstractSocket *socket;
+    if (udp) {
+        socket = new QUdpSocket(this);
+        connect(socket, SIGNAL(connected()), this, SLOT(onProbeConnected()));
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onProbeReadyRead()));
+    } else {
+        socket = new QTcpSocket(this);
+        connect(socket, SIGNAL(connected()), this, SLOT(onProbeConnected()));
+    }
+    connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onProbeError()));
+
+    Probe probe;
+    probe.server = server;
+    probe.startTime = currentTime;
+    inFlight.insert(socket, probe);
+    inFlightServers.insert(server, socket);
+
+    socket->connectToHost(QHostAddress(server->getIp()), server->port);
+}
+
+void Prober::finishProbe(QAbstractSocket *socket, int result)
+{
+    QHash<QAbstractSocket*, Probe>::iterator it = inFlight.find(socket);
+    if (it == inFlight.end()) {
+        return;
+    }
+
+    Probe probe = it.value();
+    inFlight.erase(it);
+    inFlightServers.remove(probe.server);
+
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+
+    Server *server = probe.server;
+    qint64 currentTime = Clock::get()->currentMSecsSinceEpoch();
+    bool wasHidden = server->hidden;
+
+    if (result > 0) {
+        server->latency = currentTime - probe.startTime;
+        server->probeFailures = 0;
+        server->hidden = false;
+    } else if (result == 0) {
+        server->probeFailures ++;
+        if (server->probeFailures >= settings.getProbeFailuresToHide()) {
+            server->hidden = true;
+        }
+    }
+
+    qDebug("Probe of server %s:%u %s. Latency %d ms, %d failures in a row.", qPrintable(server->getIp()), server->port, result > 0 ? "succeeded" : result == 0 ? "failed" : "got no answer", server->latency, server->probeFailures);
+
+    scheduleProbe(server, currentTime, settings.getProbeIntervalSeconds() * 1000);
+
+    if (wasHidden != server->hidden) {
+        qDebug("Server %s:%u is %s.", qPrintable(server->getIp()), server->port, server->hidden ? "unreachable, hiding it" : "reachable again");
+        emit serverVisibilityChanged(server);
+    }
+}
+
+void Prober::onTick()
+{
+    qint64 currentTime = Clock::get()->currentMSecsSinceEpoch();
+
+    // fail the probes that took too long
+    QList<QAbstractSocket*> timedOut;
+    for (QHash<QAbstractSocket*, Probe>::const_iterator it = inFlight.constBegin(); it != inFlight.constEnd(); ++ it) {
+        if (currentTime - it.value().startTime > settings.getProbeTimeoutMilliseconds()) {
+            timedOut << it.key();
+        }
+    }
+    foreach (QAbstractSocket *socket, timedOut) {
+        // a silent UDP port is not a closed one
+        finishProbe(socket, udp ? -1 : 0);
+    }
+
+    // start the due ones, as many as the concurrency limit allows
+    int maxConcurrentProbes = settings.getMaxConcurrentProbes();
+    while (inFlight.size() < maxConcurrentProbes && !schedule.isEmpty() && schedule.constBegin().key() <= currentTime) {
+        Server *server = schedule.constBegin().value();
+        schedule.erase(schedule.begin());
+        launchProbe(server, currentTime);
+    }
+}
+
+void Prober::onProbeConnected()
+{
+    QAbstractSocket *socket = qobject_cast<QAbstractSocket*>(sender());
+
+    if (!udp) {
+        finishProbe(socket, 1);
+    } else if (socket->write(PROBE_DATAGRAM, sizeof(PROBE_DATAGRAM) - 1) != sizeof(PROBE_DATAGRAM) - 1) {
+        finishProbe(socket, 0);
+    }
+}
+
+void Prober::onProbeReadyRead()
+{
+    QUdpSocket *socket = qobject_cast<QUdpSocket*>(sender());
+
+    // the ICMP port unreachable of a connected UDP socket surfaces as a failed read
+    char datagram[1];
+    finishProbe(socket, socket->readDatagram(datagram, sizeof(datagram)) >= 0 ? 1 : 0);
+}
+
+void Prober::onProbeError()
+{
+    finishProbe(qobject_cast<QAbstractSocket*>(sender()), 0);
+}
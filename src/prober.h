@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PROBER_H
+#define PROBER_H
+
+#include <QHash>
+#include <QMultiMap>
+#include <QObject>
+
+class QAbstractSocket;
+class QTimer;
+class Server;
+class Settings;
+
+// Periodically checks that registered servers are reachable on the port they have registered with.
+// Probes are limited in number both globally and per server.
+//
+// By default a probe is a plain non-blocking TCP connect, which counts timeouts as failures.
+//
+// NFK game servers talk UDP, so UDP probes are available too: a datagram sent to the server's port.
+// An ICMP port unreachable proves the server isn't there, an answer proves it is and gives the
+// latency. Silence proves nothing and doesn't count as a failure. The game doesn't answer the probe
+// datagram, so UDP probes only measure latency against a responder that cooperates, e.g. one
+// running next to the server.
+class Prober : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Prober(QObject *parent = 0);
+
+    void start();
+
+    void addServer(Server *server);
+    void removeServer(Server *server);
+
+signals:
+    // a server got hidden from or returned to the server list
+    void serverVisibilityChanged(Server *server);
+
+private:
+    struct Probe {
+        Server *server;
+        qint64 startTime;
+    };
+
+    QTimer *tickTimer;
+
+    // servers waiting for their next probe, ordered by the time it's due
+    QMultiMap<qint64, Server*> schedule;
+    QHash<QAbstractSocket*, Probe> inFlight;
+    QHash<Server*, QAbstractSocket*> inFlightServers;
+    bool udp;
+
+    Settings &settings;
+
+    void launchProbe(Server *server, qint64 currentTime);
+    // result is 1 for success, 0 for failure and -1 for a probe that proved nothing
+    void finishProbe(QAbstractSocket *socket, int result);
+    void scheduleProbe(Server *server, qint64 currentTime, qint64 interval);
+
+private slots:
+    void onTick();
+    void onProbeConnected();
+    void onProbeReadyRead();
+    void onProbeError();
+
+};
+
+#endif // PROBER_H
@@ -23,6 +23,50 @@
 
 #include "server.h"
 
+#include <cstring>
+
+Server::Server() :
+    client(NULL), heartbeatToken(0), lastHeartbeat(0), nextProbeTime(0), ipv4(0), id(0), probeFailures(0), latency(-1), port(0),
+    hostnameLength(0), mapnameLength(0), ipLength(0), maxUsers('0'), currentUsers('0'), gametype('0'), hidden(false),
+    stringsCapacity(INLINE_CAPACITY)
+{
+    // intentially left blank
+}
+
+Server::~Server()
+{
+    if (stringsCapacity > INLINE_CAPACITY) {
+        delete[] heapStrings;
+    }
+}
+
+void Server::setStrings(const char *ip, int ipLength, const char *hostname, int hostnameLength, const char *mapname, int mapnameLength)
+{
+    // put together aside first, the values may point into the current buffer
+    char buffer[MAX_IP_LENGTH + 2 * MAX_STRING_LENGTH];
+    memcpy(buffer, ip, ipLength);
+    memcpy(buffer + ipLength, hostname, hostnameLength);
+    memcpy(buffer + ipLength + hostnameLength, mapname, mapnameLength);
+    int size = ipLength + hostnameLength + mapnameLength;
+
+    if (size > stringsCapacity || (stringsCapacity > INLINE_CAPACITY && size <= INLINE_CAPACITY)) {
+        if (stringsCapacity > INLINE_CAPACITY) {
+            delete[] heapStrings;
+        }
+        if (size > INLINE_CAPACITY) {
+            heapStrings = new char[size];
+            stringsCapacity = size;
+        } else {
+            stringsCapacity = INLINE_CAPACITY;
+        }
+    }
+
+    memcpy(strings(), buffer, size);
+    this->ipLength = ipLength;
+    this->hostnameLength = hostnameLength;
+    this->mapnameLength = mapnameLength;
+}
+
 QString Server::getGametypeString()
 {
     switch (gametype) {
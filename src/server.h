@@ -24,23 +24,97 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include <QByteArray>
 #include <QString>
 #include <QtGlobal>
 
 class Client;
 
+// Registered game server.
+//
+// Peer address, hostname and map name are kept back to back in a single buffer. It's part of the
+// record as long as they fit, which is the case for the names real servers use, so a typical record
+// is 128 bytes with no allocations of its own. Longer names move the buffer to a single heap block.
 class Server
 {
 public:
-    QString hostname;
-    QString mapname;
+    // the longest value a client can set: 256 bytes read per command, minus the "?X" prefix,
+    // the trailing \r\n and the terminating null
+    static const int MAX_STRING_LENGTH = 256 - 1 - 2 - 2;
+    // the longest textual IPv6 address
+    static const int MAX_IP_LENGTH = 46;
+    // room for the strings inside the record
+    static const int INLINE_CAPACITY = 64;
+
+    Server();
+    ~Server();
+
+    // NULL once a server that uses heartbeats has closed its connection
+    Client *client;
+    // issued by ?T, 0 if the server doesn't use heartbeats
+    quint64 heartbeatToken;
+    qint64 lastHeartbeat;
+    // maintained by Prober
+    qint64 nextProbeTime;
+    // 0 if the address is not an IPv4 one
+    quint32 ipv4;
+    // unique for the lifetime of the planet, newer servers get bigger ids
+    quint32 id;
+    // maintained by Prober
+    int probeFailures;
+    // round-trip time of the last successful probe in milliseconds, -1 if unknown
+    int latency;
+    quint16 port;
+    quint8 hostnameLength;
+    quint8 mapnameLength;
+    quint8 ipLength;
     char maxUsers;
     char currentUsers;
-    Client *client;
     char gametype;
-    quint16 port;
+    // maintained by Prober
+    // server failed too many probes in a row and is not shown in the server list
+    bool hidden;
+
+    // values are stored cut to truncatedLength()
+    void setHostname(const char *value, int length) {setStrings(ipData(), ipLength, value, truncatedLength(value, length), mapnameData(), mapnameLength);}
+    void setMapname(const char *value, int length) {setStrings(ipData(), ipLength, hostnameData(), hostnameLength, value, truncatedLength(value, length));}
+    // peer address of the registering client, kept here so that listing servers doesn't have to go through client's socket
+    void setIp(const char *value, int length) {setStrings(value, truncatedLength(value, qMin(length, int(MAX_IP_LENGTH))), hostnameData(), hostnameLength, mapnameData(), mapnameLength);}
+
+    const char *ipData() const {return strings();}
+    const char *hostnameData() const {return strings() + ipLength;}
+    const char *mapnameData() const {return strings() + ipLength + hostnameLength;}
+
+    // strings are kept as sent, which is Latin-1 as far as Qt is concerned
+    QString getHostname() const {return QString::fromLatin1(hostnameData(), hostnameLength);}
+    QString getMapname() const {return QString::fromLatin1(mapnameData(), mapnameLength);}
+    QString getIp() const {return QString::fromLatin1(ipData(), ipLength);}
+
+    bool hasIp(const char *value, int length) const {return length == ipLength && qstrnicmp(ipData(), value, length) == 0;}
+
+    // the length a value is stored with: cut at the first null and at MAX_STRING_LENGTH
+    static int truncatedLength(const char *value, int length) {return qstrnlen(value, qBound(0, length, int(MAX_STRING_LENGTH)));}
 
     QString getGametypeString();
+    bool isEmpty() {return currentUsers == '0';}
+    bool isFull() {return currentUsers >= maxUsers;}
+    // player counts are sent as single digit characters
+    int getPlayers() {return currentUsers >= '0' && currentUsers <= '9' ? currentUsers - '0' : 0;}
+    int getMaxPlayers() {return maxUsers >= '0' && maxUsers <= '9' ? maxUsers - '0' : 0;}
+
+private:
+    Q_DISABLE_COPY(Server)
+
+    // INLINE_CAPACITY while the strings are stored inline, the size of the heap block otherwise
+    quint16 stringsCapacity;
+    union {
+        char inlineStrings[INLINE_CAPACITY];
+        char *heapStrings;
+    };
+
+    const char *strings() const {return stringsCapacity > INLINE_CAPACITY ? heapStrings : inlineStrings;}
+    char *strings() {return stringsCapacity > INLINE_CAPACITY ? heapStrings : inlineStrings;}
+    void setStrings(const char *ip, int ipLength, const char *hostname, int hostnameLength, const char *mapname, int mapnameLength);
 
 };
 
@@ -0,0 +1,141 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "server.h"
+#include "serverindex.h"
+
+#include <QChar>
+
+ServerIndex::Filter::Filter() : hasGametype(false), gametype('0'), hasMapname(false), notEmpty(false), notFull(false), cursor(0), limit(0)
+{
+    // intentially left blank
+}
+
+void ServerIndex::insert(Server *server)
+{
+    all.insert(server->id, server);
+
+    if (!server->isEmpty()) {
+        notEmpty.insert(server->id, server);
+    }
+    if (!server->isFull()) {
+        notFull.insert(server->id, server);
+    }
+
+    byGametype[server->gametype].insert(server->id, server);
+    byMapname[mapnameHash(server->mapnameData(), server->mapnameLength)].insert(server->id, server);
+}
+
+void ServerIndex::remove(Server *server)
+{
+    all.remove(server->id);
+    notEmpty.remove(server->id);
+    notFull.remove(server->id);
+
+    QHash<char, ServerMap>::iterator gametypeIt = byGametype.find(server->gametype);
+    if (gametypeIt != byGametype.end()) {
+        gametypeIt.value().remove(server->id);
+        if (gametypeIt.value().isEmpty()) {
+            byGametype.erase(gametypeIt);
+        }
+    }
+
+    QHash<uint, ServerMap>::iterator mapnameIt = byMapname.find(mapnameHash(server->mapnameData(), server->mapnameLength));
+    if (mapnameIt != byMapname.end()) {
+        mapnameIt.value().remove(server->id);
+        if (mapnameIt.value().isEmpty()) {
+            byMapname.erase(mapnameIt);
+        }
+    }
+}
+
+bool ServerIndex::matches(const Filter &filter, Server *server)
+{
+    return !server->hidden
+            && (!filter.hasGametype || server->gametype == filter.gametype)
+            && (!filter.hasMapname || (server->mapnameLength == filter.mapname.size() && qstrnicmp(server->mapnameData(), filter.mapname.constData(), server->mapnameLength) == 0))
+            && (!filter.notEmpty || !server->isEmpty())
+            && (!filter.notFull || !server->isFull())
+            && (filter.hostnameSubstring.isEmpty() || containsCaseInsensitive(server->hostnameData(), server->hostnameLength, filter.hostnameSubstring));
+}
+
+uint ServerIndex::mapnameHash(const char *mapname, int length)
+{
+    // FNV-1a over lowercased Latin-1 characters, folding case the same way qstrnicmp() does
+    uint hash = 2166136261u;
+    for (int i = 0; i < length; i ++) {
+        hash = (hash ^ QChar::toLower(uint(quint8(mapname[i])))) * 16777619u;
+    }
+    return hash;
+}
+
+bool ServerIndex::containsCaseInsensitive(const char *haystack, int haystackLength, const QByteArray &needle)
+{
+    for (int i = 0; i + needle.size() <= haystackLength; i ++) {
+        if (qstrnicmp(haystack + i, needle.constData(), needle.size()) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ServerIndex::query(const Filter &filter, QList<Server*> &result) const
+{
+    static const ServerMap empty;
+
+    // walk the smallest index that applies and check the rest of the predicates on each server
+    const ServerMap *smallest = &all;
+
+    if (filter.hasGametype) {
+        QHash<char, ServerMap>::const_iterator it = byGametype.constFind(filter.gametype);
+        const ServerMap *candidate = it == byGametype.constEnd() ? &empty : &it.value();
+        if (candidate->size() < smallest->size()) {
+            smallest = candidate;
+        }
+    }
+    if (filter.hasMapname) {
+        QHash<uint, ServerMap>::const_iterator it = byMapname.constFind(mapnameHash(filter.mapname.constData(), filter.mapname.size()));
+        const ServerMap *candidate = it == byMapname.constEnd() ? &empty : &it.value();
+        if (candidate->size() < smallest->size()) {
+            smallest = candidate;
+        }
+    }
+    if (filter.notEmpty && notEmpty.size() < smallest->size()) {
+        smallest = &notEmpty;
+    }
+    if (filter.notFull && notFull.size() < smallest->size()) {
+        smallest = &notFull;
+    }
+
+    for (ServerMap::const_iterator it = smallest->upperBound(filter.cursor); it != smallest->constEnd(); ++ it) {
+        if (!matches(filter, it.value())) {
+            continue;
+        }
+        if (result.size() == filter.limit) {
+            return true;
+        }
+        result << it.value();
+    }
+
+    return false;
+}
@@ -0,0 +1,86 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SERVERINDEX_H
+#define SERVERINDEX_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <QtGlobal>
+
+class Server;
+
+// Secondary indexes over the registered servers, kept up to date incrementally,
+// so that a filtered server list query doesn't have to look at every server.
+// All indexes are ordered by server id, which is what the page cursor refers to.
+class ServerIndex
+{
+public:
+    struct Filter {
+        Filter();
+
+        bool hasGametype;
+        char gametype;
+        bool hasMapname;
+        // Latin-1, as sent by clients
+        QByteArray mapname;
+        QByteArray hostnameSubstring;
+        bool notEmpty;
+        bool notFull;
+        // only servers with an id greater than this are returned
+        quint32 cursor;
+        int limit;
+    };
+
+    // indexed fields of a server must not change between insert() and remove(),
+    // so remove the server before updating them and insert it back afterwards
+    void insert(Server *server);
+    void remove(Server *server);
+
+    // returns true if there might be more matching servers past the last one returned
+    bool query(const Filter &filter, QList<Server*> &result) const;
+
+private:
+    typedef QMap<quint32, Server*> ServerMap;
+
+    static bool matches(const Filter &filter, Server *server);
+    // case-insensitive hash of a map name, equal names hash equally regardless of case
+    static uint mapnameHash(const char *mapname, int length);
+    static bool containsCaseInsensitive(const char *haystack, int haystackLength, const QByteArray &needle);
+
+    ServerMap all;
+    ServerMap notEmpty;
+    ServerMap notFull;
+    QHash<char, ServerMap> byGametype;
+    // keyed by a case-insensitive hash of map name rather than by the name itself, so that no copy
+    // of the name is kept per server. Colliding names share a bucket, matches() sorts them out.
+    // an update still removes and reinserts the server in up to five maps, which costs a map node
+    // allocation in each of them
+    QHash<uint, ServerMap> byMapname;
+
+};
+
+#endif // SERVERINDEX_H
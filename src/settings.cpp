@@ -74,6 +74,17 @@ void Settings::load(const QString &filePath)
         GET_UINT(port, "port", 10003, ok)
         GET_INT(maxClients, "maxClients", 1024, ok);
         GET_INT(maxSimultaneousConnectionsFromSingleIp, "maxSimultaneousConnectionsFromSingleIp", 10, ok);
+        GET_INT(listenBacklog, "listenBacklog", 1024, ok);
+        GET_INT(acceptBatchSize, "acceptBatchSize", 64, ok);
+        GET_INT(maxPendingOutputBytes, "maxPendingOutputBytes", 256*1024, ok);
+        GET_INT(slowClientTimeoutSeconds, "slowClientTimeoutSeconds", 30, ok);
+        GET_INT(maxServerListPageSize, "maxServerListPageSize", 100, ok);
+        if (maxServerListPageSize < 1) {
+            qWarning("Invalid key \"maxServerListPageSize\" specified in settings. Using the minimum value of 1");
+            maxServerListPageSize = 1;
+        }
+        GET_INT(commandsPerTurn, "commandsPerTurn", 8, ok);
+        GET_INT(serverListCompressionLevel, "serverListCompressionLevel", 6, ok);
     s.endGroup();
 
     s.beginGroup("Penalty");
@@ -88,6 +99,7 @@ void Settings::load(const QString &filePath)
 
         GET_INT(versionRequestPenalty, "versionRequestPenalty", 1, ok)
         GET_INT(serverListRequestPenalty, "serverListRequestPenalty", 3, ok)
+        GET_INT(filteredServerListRequestPenalty, "filteredServerListRequestPenalty", 2, ok)
         GET_INT(serverRegistrationPenalty, "serverRegistrationPenalty", 5, ok)
         GET_INT(setServerNamePenalty, "setServerNamePenalty", 3, ok)
         GET_INT(setServerMapPenalty, "setServerMapPenalty", 3, ok)
@@ -97,6 +109,87 @@ void Settings::load(const QString &filePath)
         GET_INT(numberOfClientsRequestPenalty, "numberOfClientsRequestPenalty", 2, ok)
         GET_INT(pingRequestPenalty, "pingRequestPenalty", 1, ok)
         GET_INT(inviteRequestPenalty, "inviteRequestPenalty", 3, ok)
+        GET_INT(heartbeatTokenRequestPenalty, "heartbeatTokenRequestPenalty", 3, ok)
+        GET_INT(compressedServerListRequestPenalty, "compressedServerListRequestPenalty", 3, ok)
+    s.endGroup();
+
+    s.beginGroup("Prober");
+        enableProber = s.value("enable", false).toBool();
+
+        GET_INT(probeIntervalSeconds, "intervalSeconds", 60, ok)
+        GET_INT(probeJitterPercent, "jitterPercent", 20, ok)
+        GET_INT(probeTimeoutMilliseconds, "timeoutMilliseconds", 3000, ok)
+        GET_INT(probeTickMilliseconds, "tickMilliseconds", 100, ok)
+        GET_INT(maxConcurrentProbes, "maxConcurrentProbes", 256, ok)
+        GET_INT(probeFailuresToHide, "failuresToHide", 3, ok)
+        // udp only gets a latency out of servers that answer the probe datagram, which NFK itself doesn't
+        probeProtocol = s.value("protocol", "tcp").toString();
+    s.endGroup();
+
+    s.beginGroup("Capture");
+        enableCapture = s.value("enable", false).toBool();
+        captureFile = s.value("file", "traffic.trace").toString();
+    s.endGroup();
+
+    s.beginGroup("AbuseDetector");
+        enableAbuseDetector = s.value("enable", true).toBool();
+
+        GET_INT(abuseSketchWidth, "sketchWidth", 4096, ok)
+        GET_INT(abuseSketchDepth, "sketchDepth", 4, ok)
+        GET_INT(abuseTopK, "topK", 32, ok)
+        GET_INT(abuseDecayPeriodSeconds, "decayPeriodSeconds", 10, ok)
+        GET_INT(abuseIpThreshold, "ipThreshold", 500, ok)
+        GET_INT(abusePrefixLength, "prefixLength", 24, ok)
+        GET_INT(abusePrefixThreshold, "prefixThreshold", 2000, ok)
+
+        // by default hot IPs and prefixes are only logged and shown in the admin stats. acting on them is opt-in:
+        // blacklistHotIps=true bans hot IPs permanently by writing them into the settings file,
+        // rejectHotPrefixes=true refuses new connections from hot prefixes until they cool down
+        abuseBlacklistHotIps = s.value("blacklistHotIps", false).toBool();
+        abuseRejectHotPrefixes = s.value("rejectHotPrefixes", false).toBool();
+    s.endGroup();
+
+    s.beginGroup("Admin");
+        enableAdmin = s.value("enable", false).toBool();
+        adminSocket = s.value("socket", "qt-nfk-planet-admin").toString();
+    s.endGroup();
+
+    s.beginGroup("Http");
+        enableHttp = s.value("enable", false).toBool();
+        httpAddress = s.value("address", "127.0.0.1").toString();
+
+        GET_UINT(httpPort, "port", 10080, ok)
+    s.endGroup();
+
+    s.beginGroup("History");
+        // off by default, enable=true maps a file of about 1.2 MiB at the given path,
+        // which is relative to the working directory unless it's absolute
+        enableHistory = s.value("enable", false).toBool();
+        historyFile = s.value("file", "history.bin").toString();
+    s.endGroup();
+
+    s.beginGroup("Heartbeat");
+        enableHeartbeat = s.value("enable", false).toBool();
+        heartbeatAddress = s.value("address", "127.0.0.1").toString();
+
+        GET_UINT(heartbeatPort, "port", 10003, ok)
+        GET_INT(heartbeatTimeoutSeconds, "timeoutSeconds", 180, ok)
+    s.endGroup();
+
+    s.beginGroup("LoadMonitor");
+        // off by default, as it changes how the planet answers: enable=true makes it reject new connections
+        // while overloaded, serve ?G from a cache up to degradedServerListRefreshSeconds old and multiply
+        // penalties while degraded, and drop debug messages unless shedDebugMessages=false
+        enableLoadMonitor = s.value("enable", false).toBool();
+        loadShedDebugMessages = s.value("shedDebugMessages", true).toBool();
+
+        GET_INT(loadSampleMilliseconds, "sampleMilliseconds", 100, ok)
+        GET_INT(degradedLagMilliseconds, "degradedLagMilliseconds", 100, ok)
+        GET_INT(overloadedLagMilliseconds, "overloadedLagMilliseconds", 500, ok)
+        GET_INT(loadRecoverPercent, "recoverPercent", 50, ok)
+        GET_INT(loadRecoverSeconds, "recoverSeconds", 10, ok)
+        GET_INT(degradedServerListRefreshSeconds, "degradedServerListRefreshSeconds", 5, ok)
+        GET_INT(degradedPenaltyMultiplier, "degradedPenaltyMultiplier", 2, ok)
     s.endGroup();
 
     int blacklistSize = s.beginReadArray("Blacklist");
@@ -120,3 +213,21 @@ void Settings::blacklistIp(QString ip)
     s.endArray();
     blacklistedIpSet.insert(ip);
 }
+
+bool Settings::unblacklistIp(QString ip)
+{
+    if (!blacklistedIpSet.remove(ip)) {
+        return false;
+    }
+    // the array has no gaps, so rewrite it whole
+    QSettings s(settingsPath, QSettings::IniFormat);
+    s.remove("Blacklist");
+    s.beginWriteArray("Blacklist");
+        int i = 0;
+        foreach (const QString &blacklistedIp, blacklistedIpSet) {
+            s.setArrayIndex(i++);
+            s.setValue("IP", blacklistedIp);
+        }
+    s.endArray();
+    return true;
+}
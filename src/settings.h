@@ -37,6 +37,13 @@ public:
 
     int getMaxClients() {return maxClients;}
     int getMaxSimultaneousConnectionsFromSingleIp() {return maxSimultaneousConnectionsFromSingleIp;}
+    int getListenBacklog() {return listenBacklog;}
+    int getAcceptBatchSize() {return acceptBatchSize;}
+    int getMaxPendingOutputBytes() {return maxPendingOutputBytes;}
+    int getSlowClientTimeoutSeconds() {return slowClientTimeoutSeconds;}
+    int getMaxServerListPageSize() {return maxServerListPageSize;}
+    int getCommandsPerTurn() {return commandsPerTurn;}
+    int getServerListCompressionLevel() {return serverListCompressionLevel;}
 
     int getMaxPenaltyPoints() {return maxPenaltyPoints;}
     int getPenaltyPeriodSeconds() {return penaltyPeriodSeconds;}
@@ -49,6 +56,7 @@ public:
 
     int getVersionRequestPenalty() {return versionRequestPenalty;}
     int getServerListRequestPenalty() {return serverListRequestPenalty;}
+    int getFilteredServerListRequestPenalty() {return filteredServerListRequestPenalty;}
     int getServerRegistrationPenalty() {return serverRegistrationPenalty;}
     int getSetServerNamePenalty() {return setServerNamePenalty;}
     int getSetServerMapPenalty() {return setServerMapPenalty;}
@@ -58,10 +66,62 @@ public:
     int getNumberOfClientsRequestPenalty() {return numberOfClientsRequestPenalty;}
     int getPingRequestPenalty() {return pingRequestPenalty;}
     int getInviteRequestPenalty() {return inviteRequestPenalty;}
+    int getHeartbeatTokenRequestPenalty() {return heartbeatTokenRequestPenalty;}
+    int getCompressedServerListRequestPenalty() {return compressedServerListRequestPenalty;}
+
+    bool getEnableProber() {return enableProber;}
+    int getProbeIntervalSeconds() {return probeIntervalSeconds;}
+    int getProbeJitterPercent() {return probeJitterPercent;}
+    int getProbeTimeoutMilliseconds() {return probeTimeoutMilliseconds;}
+    int getProbeTickMilliseconds() {return probeTickMilliseconds;}
+    int getMaxConcurrentProbes() {return maxConcurrentProbes;}
+    int getProbeFailuresToHide() {return probeFailuresToHide;}
+    QString getProbeProtocol() {return probeProtocol;}
+
+    bool getEnableCapture() {return enableCapture;}
+    QString getCaptureFile() {return captureFile;}
+
+    bool getEnableAbuseDetector() {return enableAbuseDetector;}
+    int getAbuseSketchWidth() {return abuseSketchWidth;}
+    int getAbuseSketchDepth() {return abuseSketchDepth;}
+    int getAbuseTopK() {return abuseTopK;}
+    int getAbuseDecayPeriodSeconds() {return abuseDecayPeriodSeconds;}
+    int getAbuseIpThreshold() {return abuseIpThreshold;}
+    int getAbusePrefixLength() {return abusePrefixLength;}
+    int getAbusePrefixThreshold() {return abusePrefixThreshold;}
+    bool getAbuseBlacklistHotIps() {return abuseBlacklistHotIps;}
+    bool getAbuseRejectHotPrefixes() {return abuseRejectHotPrefixes;}
+
+    bool getEnableAdmin() {return enableAdmin;}
+    QString getAdminSocket() {return adminSocket;}
+
+    bool getEnableHttp() {return enableHttp;}
+    QString getHttpAddress() {return httpAddress;}
+    quint16 getHttpPort() {return httpPort;}
+
+    bool getEnableHistory() {return enableHistory;}
+    QString getHistoryFile() {return historyFile;}
+
+    bool getEnableHeartbeat() {return enableHeartbeat;}
+    QString getHeartbeatAddress() {return heartbeatAddress;}
+    quint16 getHeartbeatPort() {return heartbeatPort;}
+    int getHeartbeatTimeoutSeconds() {return heartbeatTimeoutSeconds;}
+
+    bool getEnableLoadMonitor() {return enableLoadMonitor;}
+    int getLoadSampleMilliseconds() {return loadSampleMilliseconds;}
+    int getDegradedLagMilliseconds() {return degradedLagMilliseconds;}
+    int getOverloadedLagMilliseconds() {return overloadedLagMilliseconds;}
+    int getLoadRecoverPercent() {return loadRecoverPercent;}
+    int getLoadRecoverSeconds() {return loadRecoverSeconds;}
+    int getDegradedServerListRefreshSeconds() {return degradedServerListRefreshSeconds;}
+    int getDegradedPenaltyMultiplier() {return degradedPenaltyMultiplier;}
+    bool getLoadShedDebugMessages() {return loadShedDebugMessages;}
 
     QSet<QString> getBlacklistedIps() {return blacklistedIpSet;}
 
     void blacklistIp(QString ip);
+    // returns false if the IP wasn't blacklisted
+    bool unblacklistIp(QString ip);
 
 private:
     Settings();
@@ -79,6 +139,13 @@ private:
 
     int maxClients;
     int maxSimultaneousConnectionsFromSingleIp;
+    int listenBacklog;
+    int acceptBatchSize;
+    int maxPendingOutputBytes;
+    int slowClientTimeoutSeconds;
+    int maxServerListPageSize;
+    int commandsPerTurn;
+    int serverListCompressionLevel;
 
     int maxPenaltyPoints;
     int penaltyPeriodSeconds;
@@ -91,6 +158,7 @@ private:
 
     int versionRequestPenalty;
     int serverListRequestPenalty;
+    int filteredServerListRequestPenalty;
     int serverRegistrationPenalty;
     int setServerNamePenalty;
     int setServerMapPenalty;
@@ -100,6 +168,56 @@ private:
     int numberOfClientsRequestPenalty;
     int pingRequestPenalty;
     int inviteRequestPenalty;
+    int heartbeatTokenRequestPenalty;
+    int compressedServerListRequestPenalty;
+
+    bool enableProber;
+    int probeIntervalSeconds;
+    int probeJitterPercent;
+    int probeTimeoutMilliseconds;
+    int probeTickMilliseconds;
+    int maxConcurrentProbes;
+    int probeFailuresToHide;
+    QString probeProtocol;
+
+    bool enableCapture;
+    QString captureFile;
+
+    bool enableAbuseDetector;
+    int abuseSketchWidth;
+    int abuseSketchDepth;
+    int abuseTopK;
+    int abuseDecayPeriodSeconds;
+    int abuseIpThreshold;
+    int abusePrefixLength;
+    int abusePrefixThreshold;
+    bool abuseBlacklistHotIps;
+    bool abuseRejectHotPrefixes;
+
+    bool enableAdmin;
+    QString adminSocket;
+
+    bool enableHttp;
+    QString httpAddress;
+    quint16 httpPort;
+
+    bool enableHistory;
+    QString historyFile;
+
+    bool enableHeartbeat;
+    QString heartbeatAddress;
+    quint16 heartbeatPort;
+    int heartbeatTimeoutSeconds;
+
+    bool enableLoadMonitor;
+    int loadSampleMilliseconds;
+    int degradedLagMilliseconds;
+    int overloadedLagMilliseconds;
+    int loadRecoverPercent;
+    int loadRecoverSeconds;
+    int degradedServerListRefreshSeconds;
+    int degradedPenaltyMultiplier;
+    bool loadShedDebugMessages;
 
     QSet<QString> blacklistedIpSet;
 
@@ -0,0 +1,224 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "planet.h"
+#include "statshistory.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QTimer>
+
+#include <cstring>
+
+const char StatsHistory::MAGIC[8] = {'N', 'F', 'K', 'H', 'I', 'S', 'T', '1'};
+const int StatsHistory::PERIOD[TierCount] = {1, 60, 60*60};
+// an hour of seconds, a day of minutes, a year of hours
+const int StatsHistory::CAPACITY[TierCount] = {60*60, 24*60, 365*24};
+
+StatsHistory::StatsHistory(Planet *planet) : QObject(planet), planet(planet), map(NULL), header(NULL)
+{
+    memset(tiers, 0, sizeof(tiers));
+    memset(accumulators, 0, sizeof(accumulators));
+    memset(lastCommandCounts, 0, sizeof(lastCommandCounts));
+
+    sampleTimer = new QTimer(this);
+    connect(sampleTimer, SIGNAL(timeout()), this, SLOT(onSample()));
+}
+
+StatsHistory::~StatsHistory()
+{
+    if (map != NULL) {
+        file.unmap(map);
+    }
+}
+
+bool StatsHistory::start(const QString &filePath)
+{
+    // samples follow the header, so both must keep them 8 byte aligned
+    Q_ASSERT(sizeof(Header) % 8 == 0 && sizeof(Sample) % 8 == 0);
+
+    qint64 size = sizeof(Header);
+    for (int i = 0; i < TierCount; i ++) {
+        size += qint64(CAPACITY[i]) * sizeof(Sample);
+    }
+
+    Header expected;
+    memset(&expected, 0, sizeof(expected));
+    memcpy(expected.magic, MAGIC, sizeof(MAGIC));
+    expected.sampleSize = sizeof(Sample);
+    for (int i = 0; i < TierCount; i ++) {
+        expected.capacity[i] = CAPACITY[i];
+    }
+    for (int i = 0; i < qMin(Planet::getCommandCount(), int(COMMAND_SLOTS)); i ++) {
+        expected.commands[i] = Planet::getCommand(i);
+    }
+
+    file.setFileName(filePath);
+    if (!file.open(QIODevice::ReadWrite)) {
+        qWarning("Failed to open history file %s. %s.", qPrintable(filePath), qPrintable(file.errorString()));
+        return false;
+    }
+
+    Header existing;
+    bool reuse = file.size() == size && file.read(reinterpret_cast<char*>(&existing), sizeof(existing)) == sizeof(existing)
+            && memcmp(&existing, &expected, sizeof(expected)) == 0;
+
+    // start over if the file was written with a different layout, zeroes mark empty slots
+    if (!reuse && (!file.resize(0) || !file.resize(size))) {
+        qWarning("Failed to resize history file %s. %s.", qPrintable(filePath), qPrintable(file.errorString()));
+        file.close();
+        return false;
+    }
+
+    map = file.map(0, size);
+    if (map == NULL) {
+        qWarning("Failed to map history file %s. %s.", qPrintable(filePath), qPrintable(file.errorString()));
+        file.close();
+        return false;
+    }
+
+    header = reinterpret_cast<Header*>(map);
+    memcpy(header, &expected, sizeof(expected));
+
+    Sample *samples = reinterpret_cast<Sample*>(map + sizeof(Header));
+    for (int i = 0; i < TierCount; i ++) {
+        tiers[i] = samples;
+        samples += CAPACITY[i];
+    }
+
+    for (int i = 0; i < qMin(Planet::getCommandCount(), int(COMMAND_SLOTS)); i ++) {
+        lastCommandCounts[i] = planet->getCommandStats(i).count;
+    }
+
+    sampleTimer->start(1000);
+
+    // said out loud, the file is big enough for an operator to want to know where it is
+    qWarning("Recording statistics history into %s (%lld bytes)%s.", qPrintable(QFileInfo(file).absoluteFilePath()), size, reuse ? ", continuing the existing history" : "");
+    return true;
+}
+
+const char *StatsHistory::getTierName(int tier)
+{
+    switch (tier) {
+        case Seconds:
+            return "second";
+        case Minutes:
+            return "minute";
+        case Hours:
+            return "hour";
+        default:
+            return "unknown";
+    }
+}
+
+QByteArray StatsHistory::getCommands() const
+{
+    return QByteArray(header->commands, qstrnlen(header->commands, COMMAND_SLOTS));
+}
+
+void StatsHistory::store(int tier, const Sample &sample)
+{
+    tiers[tier][(sample.time / PERIOD[tier]) % CAPACITY[tier]] = sample;
+}
+
+void StatsHistory::accumulate(int tier, const Sample &sample)
+{
+    Accumulator &accumulator = accumulators[tier];
+    qint64 time = sample.time - sample.time % PERIOD[tier];
+
+    // a sample of the next period closes the current one
+    if (accumulator.count != 0 && accumulator.time != time) {
+        Sample average;
+        memset(&average, 0, sizeof(average));
+        average.time = accumulator.time;
+        average.servers = accumulator.servers / accumulator.count;
+        average.players = accumulator.players / accumulator.count;
+        average.clients = accumulator.clients / accumulator.count;
+        // command counts add up, the period is just longer
+        for (int i = 0; i < COMMAND_SLOTS; i ++) {
+            average.commands[i] = qMin(accumulator.commands[i], quint64(0xFFFFFFFF));
+        }
+
+        store(tier, average);
+        if (tier + 1 < TierCount) {
+            accumulate(tier + 1, average);
+        }
+
+        memset(&accumulator, 0, sizeof(accumulator));
+    }
+
+    accumulator.time = time;
+    accumulator.count ++;
+    accumulator.servers += sample.servers;
+    accumulator.players += sample.players;
+    accumulator.clients += sample.clients;
+    for (int i = 0; i < COMMAND_SLOTS; i ++) {
+        accumulator.commands[i] += sample.commands[i];
+    }
+}
+
+QVector<StatsHistory::Sample> StatsHistory::query(int tier, qint64 from, qint64 to) const
+{
+    QVector<Sample> result;
+
+    if (map == NULL || tier < 0 || tier >= TierCount || from > to) {
+        return result;
+    }
+
+    // only the last CAPACITY periods can still be there
+    qint64 period = PERIOD[tier];
+    from = qMax(from, to - (CAPACITY[tier] - 1) * period);
+    from = (from + period - 1) / period * period;
+
+    for (qint64 time = from; time <= to; time += period) {
+        const Sample &sample = tiers[tier][(time / period) % CAPACITY[tier]];
+        // the slot might hold an older sample that mapped to it, or nothing
+        if (sample.time == time) {
+            result << sample;
+        }
+    }
+
+    return result;
+}
+
+void StatsHistory::onSample()
+{
+    Sample sample;
+    memset(&sample, 0, sizeof(sample));
+
+    Planet::Stats stats;
+    planet->getStats(stats);
+
+    sample.time = QDateTime::currentMSecsSinceEpoch() / 1000;
+    sample.servers = stats.servers;
+    sample.clients = stats.clients;
+    sample.players = stats.players;
+    for (int i = 0; i < qMin(Planet::getCommandCount(), int(COMMAND_SLOTS)); i ++) {
+        quint64 count = planet->getCommandStats(i).count;
+        sample.commands[i] = count - lastCommandCounts[i];
+        lastCommandCounts[i] = count;
+    }
+
+    store(Seconds, sample);
+    accumulate(Minutes, sample);
+}
@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef STATSHISTORY_H
+#define STATSHISTORY_H
+
+#include <QFile>
+#include <QObject>
+#include <QVector>
+
+class Planet;
+class QTimer;
+
+// Keeps a history of planet-wide statistics in a memory-mapped file of fixed size.
+//
+// A sample is taken every second. The file holds three tiers of fixed-width samples: an hour of
+// seconds, a day of minutes and a year of hours, the coarser ones averaged from the finer ones.
+// Each tier is a ring indexed by time, so a sample is written into the slot its time maps to and
+// a range is read by visiting exactly the slots it covers. Writing is just storing into mapped
+// memory, the kernel writes dirty pages back on its own, so the event loop never waits on disk.
+// History survives restarts as long as the layout of the file doesn't change.
+class StatsHistory : public QObject
+{
+    Q_OBJECT
+public:
+    explicit StatsHistory(Planet *planet);
+    ~StatsHistory();
+
+    enum Tier {
+        Seconds,
+        Minutes,
+        Hours,
+        TierCount
+    };
+
+    // enough for all commands the planet knows of
+    static const int COMMAND_SLOTS = 16;
+
+    // laid out as stored in the file, host byte order
+    struct Sample {
+        // start of the period in seconds since epoch, 0 if the slot is empty
+        qint64 time;
+        quint32 servers;
+        // sum of current player counts of all servers
+        quint32 players;
+        quint32 clients;
+        quint32 reserved;
+        // commands received during the period, in Planet::getCommand() order
+        quint32 commands[COMMAND_SLOTS];
+    };
+
+    bool start(const QString &filePath);
+    bool isStarted() const {return map != NULL;}
+
+    // samples of a tier starting within [from, to] seconds since epoch, oldest first
+    QVector<Sample> query(int tier, qint64 from, qint64 to) const;
+
+    static int getTierPeriod(int tier) {return PERIOD[tier];}
+    static int getTierCapacity(int tier) {return CAPACITY[tier];}
+    static const char *getTierName(int tier);
+    // letters of the commands, in the order of Sample::commands
+    QByteArray getCommands() const;
+
+private:
+    struct Header {
+        char magic[8];
+        quint32 sampleSize;
+        quint32 capacity[TierCount];
+        char commands[COMMAND_SLOTS];
+    };
+
+    // running average of the samples that go into the current period of a coarser tier
+    struct Accumulator {
+        qint64 time;
+        int count;
+        quint64 servers;
+        quint64 players;
+        quint64 clients;
+        quint64 commands[COMMAND_SLOTS];
+    };
+
+    Planet *planet;
+    QFile file;
+    uchar *map;
+    Header *header;
+    Sample *tiers[TierCount];
+    Accumulator accumulators[TierCount];
+    quint64 lastCommandCounts[COMMAND_SLOTS];
+    QTimer *sampleTimer;
+
+    static const char MAGIC[8];
+    static const int PERIOD[TierCount];
+    static const int CAPACITY[TierCount];
+
+    void store(int tier, const Sample &sample);
+    void accumulate(int tier, const Sample &sample);
+
+private slots:
+    void onSample();
+
+};
+
+#endif // STATSHISTORY_H
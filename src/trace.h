@@ -0,0 +1,74 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QtEndian>
+#include <QtGlobal>
+
+// Format of the traffic capture files, shared by the planet and the replay tool.
+//
+// A file starts with MAGIC, followed by records. Each record is a fixed-size little-endian
+// header followed by `length` bytes of payload: peer address for Accept, received bytes for Data
+// and nothing for Disconnect. Files are only ever appended to.
+namespace Trace {
+
+static const char MAGIC[] = "NFKTRACE1\n";
+static const int MAGIC_LENGTH = sizeof(MAGIC) - 1;
+
+enum RecordType {
+    Accept = 1,
+    Data = 2,
+    Disconnect = 3
+};
+
+struct RecordHeader {
+    quint8 type;
+    quint32 connectionId;
+    // milliseconds since the capture has started
+    qint64 time;
+    quint16 length;
+};
+
+static const int RECORD_HEADER_SIZE = 1 + 4 + 8 + 2;
+
+inline void writeHeader(const RecordHeader &header, uchar *out)
+{
+    out[0] = header.type;
+    qToLittleEndian<quint32>(header.connectionId, out + 1);
+    qToLittleEndian<qint64>(header.time, out + 5);
+    qToLittleEndian<quint16>(header.length, out + 13);
+}
+
+inline void readHeader(const uchar *in, RecordHeader &header)
+{
+    header.type = in[0];
+    header.connectionId = qFromLittleEndian<quint32>(in + 1);
+    header.time = qFromLittleEndian<qint64>(in + 5);
+    header.length = qFromLittleEndian<quint16>(in + 13);
+}
+
+}
+
+#endif // TRACE_H
@@ -0,0 +1,111 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "trace.h"
+#include "trafficrecorder.h"
+
+#include <QTimer>
+
+TrafficRecorder::TrafficRecorder(QObject *parent) : QObject(parent)
+{
+    flushTimer = new QTimer(this);
+    flushTimer->setInterval(FLUSH_INTERVAL);
+    connect(flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+TrafficRecorder::~TrafficRecorder()
+{
+    flush();
+}
+
+bool TrafficRecorder::start(const QString &filePath)
+{
+    file.setFileName(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning("Failed to open traffic capture file %s. %s.", qPrintable(filePath), qPrintable(file.errorString()));
+        return false;
+    }
+
+    // every capture session starts with the magic, so that appending to an old file still gives sessions a replay tool can tell apart
+    buffer.append(Trace::MAGIC, Trace::MAGIC_LENGTH);
+
+    time.start();
+    flushTimer->start();
+
+    return true;
+}
+
+void TrafficRecorder::record(quint8 type, quint32 connectionId, const char *data, qint64 length)
+{
+    if (!file.isOpen()) {
+        return;
+    }
+
+    Trace::RecordHeader header;
+    header.type = type;
+    header.connectionId = connectionId;
+    header.time = time.elapsed();
+    header.length = qMin(length, qint64(0xFFFF));
+
+    uchar headerBytes[Trace::RECORD_HEADER_SIZE];
+    Trace::writeHeader(header, headerBytes);
+
+    buffer.append(reinterpret_cast<char*>(headerBytes), Trace::RECORD_HEADER_SIZE);
+    buffer.append(data, header.length);
+
+    if (buffer.size() >= FLUSH_THRESHOLD) {
+        flush();
+    }
+}
+
+void TrafficRecorder::recordAccept(quint32 connectionId, const QString &address)
+{
+    QByteArray addressBytes = address.toAscii();
+    record(Trace::Accept, connectionId, addressBytes.constData(), addressBytes.size());
+}
+
+void TrafficRecorder::recordData(quint32 connectionId, const char *data, qint64 length)
+{
+    record(Trace::Data, connectionId, data, length);
+}
+
+void TrafficRecorder::recordDisconnect(quint32 connectionId)
+{
+    record(Trace::Disconnect, connectionId, NULL, 0);
+}
+
+void TrafficRecorder::flush()
+{
+    if (!file.isOpen() || buffer.isEmpty()) {
+        return;
+    }
+
+    if (file.write(buffer) != buffer.size()) {
+        qWarning("Failed to write traffic capture file %s. %s. Stopping the capture.", qPrintable(file.fileName()), qPrintable(file.errorString()));
+        file.close();
+    } else {
+        file.flush();
+    }
+
+    buffer.clear();
+}
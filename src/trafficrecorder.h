@@ -0,0 +1,68 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TRAFFICRECORDER_H
+#define TRAFFICRECORDER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QObject>
+
+class QTimer;
+
+// Appends accepted connections, received bytes and disconnects to a trace file, see trace.h.
+// Records are collected in memory and written out in big chunks, either when enough of them
+// has accumulated or periodically.
+class TrafficRecorder : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TrafficRecorder(QObject *parent = 0);
+    ~TrafficRecorder();
+
+    bool start(const QString &filePath);
+    bool isRecording() {return file.isOpen();}
+
+    void recordAccept(quint32 connectionId, const QString &address);
+    void recordData(quint32 connectionId, const char *data, qint64 length);
+    void recordDisconnect(quint32 connectionId);
+
+private:
+    QFile file;
+    QByteArray buffer;
+    QElapsedTimer time;
+    QTimer *flushTimer;
+
+    // flush once the buffer gets this big
+    static const int FLUSH_THRESHOLD = 64*1024;
+    static const int FLUSH_INTERVAL = 1000;
+
+    void record(quint8 type, quint32 connectionId, const char *data, qint64 length);
+
+private slots:
+    void flush();
+
+};
+
+#endif // TRAFFICRECORDER_H
@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "transport.h"
+
+#include <QTcpSocket>
+
+TcpTransport::TcpTransport(QTcpSocket *socket, QObject *parent) : Transport(parent), socket(socket)
+{
+    socket->setParent(this);
+
+    connect(socket, SIGNAL(readyRead()), this, SIGNAL(readyRead()));
+    connect(socket, SIGNAL(bytesWritten(qint64)), this, SIGNAL(bytesWritten(qint64)));
+    connect(socket, SIGNAL(disconnected()), this, SIGNAL(disconnected()));
+}
+
+QHostAddress TcpTransport::peerAddress() const
+{
+    return socket->peerAddress();
+}
+
+quint16 TcpTransport::peerPort() const
+{
+    return socket->peerPort();
+}
+
+qint64 TcpTransport::bytesAvailable() const
+{
+    return socket->bytesAvailable();
+}
+
+qint64 TcpTransport::readLine(char *data, qint64 maxSize)
+{
+    return socket->readLine(data, maxSize);
+}
+
+qint64 TcpTransport::write(const char *data, qint64 size)
+{
+    return socket->write(data, size);
+}
+
+qint64 TcpTransport::bytesToWrite() const
+{
+    return socket->bytesToWrite();
+}
+
+void TcpTransport::disconnectFromHost()
+{
+    socket->disconnectFromHost();
+}
+
+void TcpTransport::abort()
+{
+    socket->abort();
+}
+
+QString TcpTransport::errorString() const
+{
+    return socket->errorString();
+}
@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <QByteArray>
+#include <QHostAddress>
+#include <QObject>
+#include <QString>
+
+class QTcpSocket;
+
+// Connection of a client, as much of it as the planet uses.
+//
+// Methods and signals are named and behave like their QTcpSocket counterparts. In particular,
+// disconnectFromHost() and abort() may emit disconnected() before returning. The planet talks to
+// clients only through this, so that the simulator can put fake connections in place of sockets.
+class Transport : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Transport(QObject *parent = 0) : QObject(parent) {}
+
+    virtual QHostAddress peerAddress() const = 0;
+    virtual quint16 peerPort() const = 0;
+
+    virtual qint64 bytesAvailable() const = 0;
+    virtual qint64 readLine(char *data, qint64 maxSize) = 0;
+    virtual qint64 write(const char *data, qint64 size) = 0;
+    qint64 write(const char *data) {return write(data, qstrlen(data));}
+    qint64 write(const QByteArray &data) {return write(data.constData(), data.size());}
+    virtual qint64 bytesToWrite() const = 0;
+
+    virtual void disconnectFromHost() = 0;
+    virtual void abort() = 0;
+    virtual QString errorString() const = 0;
+
+signals:
+    void readyRead();
+    void bytesWritten(qint64 bytes);
+    void disconnected();
+
+};
+
+class TcpTransport : public Transport
+{
+    Q_OBJECT
+public:
+    // takes the ownership of the socket
+    explicit TcpTransport(QTcpSocket *socket, QObject *parent = 0);
+
+    QHostAddress peerAddress() const;
+    quint16 peerPort() const;
+
+    qint64 bytesAvailable() const;
+    qint64 readLine(char *data, qint64 maxSize);
+    qint64 write(const char *data, qint64 size);
+    using Transport::write;
+    qint64 bytesToWrite() const;
+
+    void disconnectFromHost();
+    void abort();
+    QString errorString() const;
+
+private:
+    QTcpSocket *socket;
+
+};
+
+#endif // TRANSPORT_H
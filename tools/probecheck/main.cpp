@@ -0,0 +1,181 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "responder.h"
+#include "../../src/prober.h"
+#include "../../src/server.h"
+#include "../../src/settings.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QSettings>
+#include <QStringList>
+#include <QTimer>
+
+#include <cstdio>
+
+static bool verbose = false;
+
+#if QT_VERSION >= 0x050000
+static void messageHandler(QtMsgType type, const QMessageLogContext &, const QString &message)
+{
+    if (verbose || type != QtDebugMsg) {
+        fprintf(stderr, "%s\n", qPrintable(message));
+    }
+}
+#else
+static void messageHandler(QtMsgType type, const char *message)
+{
+    if (verbose || type != QtDebugMsg) {
+        fprintf(stderr, "%s\n", message);
+    }
+}
+#endif
+
+static void printUsage(const char *name)
+{
+    printf("Usage: %s [options]\n"
+           "Probes local stand-in game servers with qt-nfk-planet's prober and checks that\n"
+           "reachable, closed and silent ports are told apart. Exits with 1 if any check fails.\n\n"
+           "  --protocol <name>     udp or tcp, tcp by default\n"
+           "  --verbose             show prober's debug messages too\n", name);
+}
+
+struct Case {
+    const char *name;
+    Responder::Behaviour behaviour;
+    Responder *responder;
+    Server *server;
+};
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList args = a.arguments();
+
+    QString protocol = "tcp";
+
+    for (int i = 1; i < args.size(); i ++) {
+        bool ok = true;
+        if (args[i] == "--verbose") {
+            verbose = true;
+        } else if (i + 1 < args.size() && args[i] == "--protocol") {
+            protocol = args[++ i];
+            ok = protocol == "udp" || protocol == "tcp";
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+
+#if QT_VERSION >= 0x050000
+    qInstallMessageHandler(messageHandler);
+#else
+    qInstallMsgHandler(messageHandler);
+#endif
+
+    // one probe per server, hiding on the first failure, all of it within a couple of seconds
+    QString settingsFile = QDir::temp().filePath("qt-nfk-probecheck.ini");
+    QFile::remove(settingsFile);
+    {
+        QSettings s(settingsFile, QSettings::IniFormat);
+        s.setValue("Prober/enable", true);
+        s.setValue("Prober/intervalSeconds", 1);
+        s.setValue("Prober/jitterPercent", 0);
+        s.setValue("Prober/timeoutMilliseconds", 500);
+        s.setValue("Prober/tickMilliseconds", 20);
+        s.setValue("Prober/failuresToHide", 1);
+        s.setValue("Prober/protocol", protocol);
+        s.setValue("Admin/enable", false);
+        s.setValue("History/enable", false);
+        s.sync();
+    }
+    Settings::getInstance(settingsFile);
+
+    bool udp = protocol == "udp";
+    Case cases[] = {
+        {"reachable", Responder::Answering, NULL, NULL},
+        {"closed", Responder::Closed, NULL, NULL},
+        {"timeout", Responder::Silent, NULL, NULL}
+    };
+    const int caseCount = sizeof(cases) / sizeof(cases[0]);
+
+    Prober prober;
+    prober.start();
+
+    for (int i = 0; i < caseCount; i ++) {
+        cases[i].responder = new Responder(udp, cases[i].behaviour, &a);
+        quint16 port = cases[i].responder->start();
+        if (port == 0) {
+            continue;
+        }
+
+        cases[i].server = new Server();
+        cases[i].server->setIp("127.0.0.1", 9);
+        cases[i].server->port = port;
+        prober.addServer(cases[i].server);
+    }
+
+    // the first probes are due in a second and time out half a second later, the second ones are not due yet
+    QTimer::singleShot(1800, &a, SLOT(quit()));
+    a.exec();
+
+    int failed = 0;
+    for (int i = 0; i < caseCount; i ++) {
+        Server *server = cases[i].server;
+        if (server == NULL) {
+            printf("%s %-10s SKIPPED, the responder couldn't be set up\n", qPrintable(protocol), cases[i].name);
+            continue;
+        }
+
+        bool passed;
+        switch (cases[i].behaviour) {
+            case Responder::Answering:
+                passed = !server->hidden && server->latency >= 0;
+                break;
+            case Responder::Closed:
+                passed = server->hidden;
+                break;
+            default:
+                // silence is a failure for a connect, but proves nothing for a datagram
+                passed = udp ? !server->hidden && server->probeFailures == 0 && server->latency == -1 : server->hidden;
+                break;
+        }
+
+        printf("%s %-10s %s (hidden %d, failures %d, latency %d ms)\n", qPrintable(protocol), cases[i].name, passed ? "PASSED" : "FAILED", server->hidden, server->probeFailures, server->latency);
+        if (!passed) {
+            failed ++;
+        }
+
+        prober.removeServer(server);
+        delete server;
+    }
+
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "responder.h"
+
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QUdpSocket>
+
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+Responder::Responder(bool udp, Behaviour behaviour, QObject *parent) :
+    QObject(parent), udp(udp), behaviour(behaviour), tcpServer(NULL), udpSocket(NULL), stalledFd(-1)
+{
+    // intentially left blank
+}
+
+Responder::~Responder()
+{
+    qDeleteAll(fillers);
+#ifdef Q_OS_UNIX
+    if (stalledFd != -1) {
+        ::close(stalledFd);
+    }
+#endif
+}
+
+quint16 Responder::start()
+{
+    if (behaviour == Closed) {
+        return reservePort();
+    }
+
+    if (udp) {
+        udpSocket = new QUdpSocket(this);
+        if (!udpSocket->bind(QHostAddress::LocalHost, 0)) {
+            qWarning("Failed to bind a UDP responder. %s.", qPrintable(udpSocket->errorString()));
+            return 0;
+        }
+        connect(udpSocket, SIGNAL(readyRead()), this, SLOT(onDatagram()));
+        return udpSocket->localPort();
+    }
+
+    if (behaviour == Silent) {
+        return startStalledListener();
+    }
+
+    tcpServer = new QTcpServer(this);
+    if (!tcpServer->listen(QHostAddress::LocalHost, 0)) {
+        qWarning("Failed to start a TCP responder. %s.", qPrintable(tcpServer->errorString()));
+        return 0;
+    }
+    connect(tcpServer, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+    return tcpServer->serverPort();
+}
+
+quint16 Responder::reservePort()
+{
+    // the port was free a moment ago and nobody is going to take it in the meantime
+    quint16 port = 0;
+    if (udp) {
+        QUdpSocket socket;
+        if (socket.bind(QHostAddress::LocalHost, 0)) {
+            port = socket.localPort();
+        }
+    } else {
+        QTcpServer server;
+        if (server.listen(QHostAddress::LocalHost, 0)) {
+            port = server.serverPort();
+        }
+    }
+    return port;
+}
+
+quint16 Responder::startStalledListener()
+{
+#ifdef Q_OS_UNIX
+    // a listener whose accept queue is full drops new SYNs, so connecting to it times out
+    stalledFd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (stalledFd == -1) {
+        return 0;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (::bind(stalledFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0
+            || ::listen(stalledFd, 0) != 0
+            || ::getsockname(stalledFd, reinterpret_cast<struct sockaddr*>(&address), &length) != 0) {
+        return 0;
+    }
+    quint16 port = ntohs(address.sin_port);
+
+    // never accepted, these fill the queue until connecting doesn't complete anymore
+    for (int i = 0; i < 8; i ++) {
+        QTcpSocket *filler = new QTcpSocket();
+        fillers.append(filler);
+        filler->connectToHost(QHostAddress::LocalHost, port);
+        if (!filler->waitForConnected(200)) {
+            filler->abort();
+            return port;
+        }
+    }
+    qWarning("Failed to fill the accept queue of the stalled TCP responder.");
+#endif
+    return 0;
+}
+
+void Responder::onNewConnection()
+{
+    while (tcpServer->hasPendingConnections()) {
+        QTcpSocket *socket = tcpServer->nextPendingConnection();
+        socket->disconnectFromHost();
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void Responder::onDatagram()
+{
+    while (udpSocket->hasPendingDatagrams()) {
+        QByteArray datagram(qMax(udpSocket->pendingDatagramSize(), qint64(0)), '\0');
+        QHostAddress sender;
+        quint16 senderPort;
+        udpSocket->readDatagram(datagram.data(), datagram.size(), &sender, &senderPort);
+        if (behaviour == Answering) {
+            udpSocket->writeDatagram(datagram, sender, senderPort);
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef RESPONDER_H
+#define RESPONDER_H
+
+#include <QList>
+#include <QObject>
+
+class QTcpServer;
+class QTcpSocket;
+class QUdpSocket;
+
+// Stand-in for a game server on a local port, behaving the way the prober has to tell apart.
+class Responder : public QObject
+{
+    Q_OBJECT
+public:
+    enum Behaviour {
+        // accepts connections, echoes datagrams
+        Answering,
+        // nothing listens on the port
+        Closed,
+        // TCP connections never complete, datagrams are read and ignored
+        Silent
+    };
+
+    Responder(bool udp, Behaviour behaviour, QObject *parent = 0);
+    ~Responder();
+
+    // port on 127.0.0.1, 0 if the responder couldn't be set up
+    quint16 start();
+
+private:
+    bool udp;
+    Behaviour behaviour;
+
+    QTcpServer *tcpServer;
+    QUdpSocket *udpSocket;
+    // listening descriptor with a full accept queue, -1 if there is none
+    int stalledFd;
+    QList<QTcpSocket*> fillers;
+
+    quint16 reservePort();
+    quint16 startStalledListener();
+
+private slots:
+    void onNewConnection();
+    void onDatagram();
+
+};
+
+#endif // RESPONDER_H
@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "acceptbench.h"
+
+#include <QCoreApplication>
+#include <QHostAddress>
+#include <QTcpSocket>
+
+#include <cstdio>
+
+// what every client sends first, the planet answers it with its version
+static const char VERSION_REQUEST[] = "?V077\r\n";
+
+AcceptBench::AcceptBench(QObject *parent) : QObject(parent), port(0), total(0), sources(1), started(0), admitted(0), closed(0), failed(0)
+{
+    // intentially left blank
+}
+
+void AcceptBench::start(const QString &address, quint16 port, int connections, int concurrency, int sources)
+{
+    this->address = address;
+    this->port = port;
+    total = connections;
+
+    if (sources == 0) {
+        sources = (QHostAddress(address).toIPv4Address() >> 24) == 127 ? concurrency : 1;
+    }
+#if QT_VERSION < 0x050000
+    if (sources > 1) {
+        fprintf(stderr, "Connecting from several source addresses needs Qt 5, all connections come from one address.\n");
+    }
+    sources = 1;
+#endif
+    this->sources = sources;
+
+    time.start();
+    startMore(qMin(concurrency, total));
+}
+
+void AcceptBench::startMore(int count)
+{
+    for (int i = 0; i < count && started < total; i ++) {
+        QTcpSocket *socket = new QTcpSocket(this);
+        connect(socket, SIGNAL(connected()), this, SLOT(onConnected()));
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(onError(QAbstractSocket::SocketError)));
+
+#if QT_VERSION >= 0x050000
+        if (sources > 1) {
+            socket->bind(QHostAddress((127u << 24) + 2 + started % sources));
+        }
+#endif
+
+        inFlight.insert(socket, time.elapsed());
+        started ++;
+
+        socket->connectToHost(QHostAddress(address), port);
+    }
+}
+
+void AcceptBench::finish(QTcpSocket *socket, Outcome outcome)
+{
+    if (!inFlight.contains(socket)) {
+        return;
+    }
+
+    qint64 startTime = inFlight.take(socket);
+
+    switch (outcome) {
+        case Admitted:
+            admitted ++;
+            replyTimes << time.elapsed() - startTime;
+            break;
+        case Closed:
+            closed ++;
+            break;
+        case Failed:
+            failed ++;
+            break;
+    }
+
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+
+    if (admitted + closed + failed == total) {
+        report();
+        QCoreApplication::quit();
+        return;
+    }
+
+    startMore(1);
+}
+
+void AcceptBench::onConnected()
+{
+    // only the kernel has seen the connection so far
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    socket->write(VERSION_REQUEST, sizeof(VERSION_REQUEST) - 1);
+}
+
+void AcceptBench::onReadyRead()
+{
+    finish(qobject_cast<QTcpSocket*>(sender()), Admitted);
+}
+
+void AcceptBench::onError(QAbstractSocket::SocketError error)
+{
+    finish(qobject_cast<QTcpSocket*>(sender()), error == QAbstractSocket::RemoteHostClosedError ? Closed : Failed);
+}
+
+void AcceptBench::report()
+{
+    qint64 elapsed = qMax(time.elapsed(), qint64(1));
+
+    printf("connections: %d, admitted: %d, closed by the planet: %d, failed: %d\n", total, admitted, closed, failed);
+    printf("elapsed: %lld ms\n", elapsed);
+    printf("admissions: %.1f/s\n", admitted * 1000.0 / elapsed);
+
+    if (closed != 0) {
+        printf("the planet rejected some connections, check its maxClients and maxSimultaneousConnectionsFromSingleIp\n");
+    }
+
+    if (replyTimes.isEmpty()) {
+        return;
+    }
+
+    // a reply taking a second or more usually means the SYN was dropped because the backlog was full
+    qSort(replyTimes);
+    printf("time to reply: p50 %lld ms, p90 %lld ms, p99 %lld ms, max %lld ms\n",
+           replyTimes[replyTimes.size() * 50 / 100],
+           replyTimes[replyTimes.size() * 90 / 100],
+           replyTimes[replyTimes.size() * 99 / 100],
+           replyTimes.last());
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef ACCEPTBENCH_H
+#define ACCEPTBENCH_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QTcpSocket>
+
+// Opens connections to the planet as fast as it admits them, keeping a fixed number of
+// connection attempts in flight, and reports admissions per second and times to the first reply.
+//
+// A connection counts only once the planet has answered its version request. The kernel
+// completes the handshake before the planet sees anything, and the planet closes the connections
+// it doesn't want right after accepting them, so neither connecting nor being accepted says much.
+// The planet allows only a few connections per IP, so on loopback connections are spread over
+// several source addresses, 127.0.0.2 and up. That needs Qt 5, with Qt 4 run the planet with
+// maxSimultaneousConnectionsFromSingleIp=-1 instead.
+class AcceptBench : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AcceptBench(QObject *parent = 0);
+
+    // sources is the number of local addresses to connect from, 0 picks one per attempt in flight on loopback
+    void start(const QString &address, quint16 port, int connections, int concurrency, int sources);
+
+private:
+    QString address;
+    quint16 port;
+    int total;
+    int sources;
+    int started;
+    // answered by the planet
+    int admitted;
+    // closed by the planet before it answered, i.e. rejected
+    int closed;
+    int failed;
+
+    QElapsedTimer time;
+    QHash<QTcpSocket*, qint64> inFlight;
+    QList<qint64> replyTimes;
+
+    enum Outcome {
+        Admitted,
+        Closed,
+        Failed
+    };
+
+    void startMore(int count);
+    void finish(QTcpSocket *socket, Outcome outcome);
+    void report();
+
+private slots:
+    void onConnected();
+    void onReadyRead();
+    void onError(QAbstractSocket::SocketError error);
+
+};
+
+#endif // ACCEPTBENCH_H
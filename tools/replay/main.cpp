@@ -0,0 +1,150 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "acceptbench.h"
+#include "pipelinebench.h"
+#include "replayer.h"
+
+#include <QCoreApplication>
+#include <QStringList>
+
+#include <cstdio>
+
+static void printUsage(const char *name)
+{
+    printf("Usage: %s [options] <trace file>\n"
+           "       %s [options] --connect-storm <connections>\n"
+           "       %s [options] --pipeline <attackers>\n"
+           "Plays a traffic capture of qt-nfk-planet against a running planet,\n"
+           "measures how fast the planet accepts connections,\n"
+           "or measures ping latency while some clients pipeline requests at the planet.\n\n"
+           "  --address <address>   planet address, 127.0.0.1 by default\n"
+           "  --port <port>         planet port, 10003 by default\n"
+           "  --fast                play as fast as possible instead of at the original speed\n"
+           "  --output <file>       save replies received on every connection\n"
+           "  --compare <file>      compare replies with the ones saved by --output earlier,\n"
+           "                        exits with 1 if they differ\n"
+           "  --connect-storm <n>   open n connections as fast as possible and report admissions per second\n"
+           "  --concurrency <n>     connection attempts in flight for --connect-storm, 256 by default\n"
+           "  --sources <n>         local addresses to connect from for --connect-storm, 127.0.0.2 and up,\n"
+           "                        so that the planet's per-IP limit doesn't reject the storm. one per\n"
+           "                        attempt in flight on loopback by default, needs Qt 5\n"
+           "  --pipeline <n>        n connections keep sending batches of ?G while probes time ?K replies,\n"
+           "                        run the planet with penalties off, and once with commandsPerTurn=0 to compare\n"
+           "  --depth <n>           ?G requests per batch for --pipeline, 1000 by default\n"
+           "  --probes <n>          pinging connections for --pipeline, 10 by default\n"
+           "  --seconds <n>         duration of --pipeline, 10 by default\n", name, name, name);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList args = a.arguments();
+
+    QString address = "127.0.0.1";
+    quint16 port = 10003;
+    bool fast = false;
+    QString traceFile;
+    QString outputFile;
+    QString compareFile;
+    int connectStorm = 0;
+    int concurrency = 256;
+    int sources = 0;
+    int pipeline = 0;
+    int depth = 1000;
+    int probes = 10;
+    int seconds = 10;
+
+    for (int i = 1; i < args.size(); i ++) {
+        bool ok = true;
+        if (args[i] == "--fast") {
+            fast = true;
+        } else if (i + 1 < args.size() && args[i] == "--address") {
+            address = args[++ i];
+        } else if (i + 1 < args.size() && args[i] == "--port") {
+            port = args[++ i].toUShort(&ok);
+        } else if (i + 1 < args.size() && args[i] == "--output") {
+            outputFile = args[++ i];
+        } else if (i + 1 < args.size() && args[i] == "--compare") {
+            compareFile = args[++ i];
+        } else if (i + 1 < args.size() && args[i] == "--connect-storm") {
+            connectStorm = args[++ i].toInt(&ok);
+            ok = ok && connectStorm > 0;
+        } else if (i + 1 < args.size() && args[i] == "--concurrency") {
+            concurrency = args[++ i].toInt(&ok);
+            ok = ok && concurrency > 0;
+        } else if (i + 1 < args.size() && args[i] == "--sources") {
+            sources = args[++ i].toInt(&ok);
+            ok = ok && sources > 0;
+        } else if (i + 1 < args.size() && args[i] == "--pipeline") {
+            pipeline = args[++ i].toInt(&ok);
+            ok = ok && pipeline > 0;
+        } else if (i + 1 < args.size() && args[i] == "--depth") {
+            depth = args[++ i].toInt(&ok);
+            ok = ok && depth > 0;
+        } else if (i + 1 < args.size() && args[i] == "--probes") {
+            probes = args[++ i].toInt(&ok);
+            ok = ok && probes > 0;
+        } else if (i + 1 < args.size() && args[i] == "--seconds") {
+            seconds = args[++ i].toInt(&ok);
+            ok = ok && seconds > 0;
+        } else if (!args[i].startsWith("--") && traceFile.isEmpty()) {
+            traceFile = args[i];
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (connectStorm > 0) {
+        AcceptBench bench;
+        bench.start(address, port, connectStorm, concurrency, sources);
+        return a.exec();
+    }
+
+    if (pipeline > 0) {
+        PipelineBench bench;
+        bench.start(address, port, pipeline, depth, probes, seconds);
+        return a.exec();
+    }
+
+    if (traceFile.isEmpty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Replayer replayer;
+    if (!replayer.load(traceFile)) {
+        return 1;
+    }
+    replayer.setOutputFile(outputFile);
+    replayer.setCompareFile(compareFile);
+    replayer.start(address, port, fast);
+
+    return a.exec();
+}
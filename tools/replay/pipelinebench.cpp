@@ -0,0 +1,186 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "pipelinebench.h"
+
+#include <QCoreApplication>
+#include <QHostAddress>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <cstdio>
+
+PipelineBench::PipelineBench(QObject *parent) : QObject(parent), port(0), depth(0), requestsSent(0), bytesReceived(0), reconnects(0)
+{
+    pingTimer = new QTimer(this);
+    connect(pingTimer, SIGNAL(timeout()), this, SLOT(onPing()));
+
+    stopTimer = new QTimer(this);
+    stopTimer->setSingleShot(true);
+    connect(stopTimer, SIGNAL(timeout()), this, SLOT(onStop()));
+}
+
+void PipelineBench::start(const QString &address, quint16 port, int attackers, int depth, int probes, int seconds)
+{
+    this->address = address;
+    this->port = port;
+    this->depth = depth;
+
+    for (int i = 0; i < depth; i ++) {
+        batch.append("?G\r\n");
+    }
+
+    time.start();
+
+    for (int i = 0; i < attackers; i ++) {
+        this->attackers << connectSocket(SLOT(onAttackerConnected()));
+    }
+
+    for (int i = 0; i < probes; i ++) {
+        QTcpSocket *socket = connectSocket(NULL);
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onProbeReadyRead()));
+        socket->write("?V077\r\n");
+
+        Probe probe;
+        probe.sentAt = -1;
+        probe.versionReceived = false;
+        this->probes.insert(socket, probe);
+    }
+
+    pingTimer->start(100);
+    stopTimer->start(seconds * 1000);
+}
+
+QTcpSocket *PipelineBench::connectSocket(const char *slot)
+{
+    QTcpSocket *socket = new QTcpSocket(this);
+    if (slot != NULL) {
+        connect(socket, SIGNAL(connected()), this, slot);
+    }
+    socket->connectToHost(QHostAddress(address), port);
+    return socket;
+}
+
+void PipelineBench::sendBatch(QTcpSocket *socket)
+{
+    socket->write(batch);
+    requestsSent += depth;
+}
+
+void PipelineBench::onAttackerConnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    connect(socket, SIGNAL(bytesWritten(qint64)), this, SLOT(onAttackerBytesWritten()));
+    connect(socket, SIGNAL(readyRead()), this, SLOT(onAttackerReadyRead()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(onAttackerDisconnected()));
+
+    socket->write("?V077\r\n");
+    sendBatch(socket);
+}
+
+void PipelineBench::onAttackerBytesWritten()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    // keep exactly one batch queued in the kernel, so that the planet always has more to read
+    if (socket->bytesToWrite() == 0) {
+        sendBatch(socket);
+    }
+}
+
+void PipelineBench::onAttackerReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    bytesReceived += socket->readAll().size();
+}
+
+void PipelineBench::onAttackerDisconnected()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+
+    // most likely penalties are on, keep the pressure up anyway
+    reconnects ++;
+    attackers.removeOne(socket);
+    socket->deleteLater();
+    attackers << connectSocket(SLOT(onAttackerConnected()));
+}
+
+void PipelineBench::onProbeReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    Probe &probe = probes[socket];
+
+    while (socket->canReadLine()) {
+        QByteArray line = socket->readLine();
+        if (line.startsWith('V')) {
+            probe.versionReceived = true;
+        } else if (line.startsWith('K') && probe.sentAt >= 0) {
+            latencies << time.nsecsElapsed() / 1000 - probe.sentAt;
+            probe.sentAt = -1;
+        }
+    }
+}
+
+void PipelineBench::onPing()
+{
+    for (QHash<QTcpSocket*, Probe>::iterator it = probes.begin(); it != probes.end(); ++ it) {
+        // one ping at a time, a late reply just means fewer samples
+        if (it.value().versionReceived && it.value().sentAt < 0 && it.key()->state() == QAbstractSocket::ConnectedState) {
+            it.value().sentAt = time.nsecsElapsed() / 1000;
+            it.key()->write("?K\r\n");
+        }
+    }
+}
+
+void PipelineBench::onStop()
+{
+    qint64 elapsed = qMax(time.elapsed(), qint64(1));
+
+    printf("attackers: %d, pipeline depth: %d, probes: %d\n", attackers.size(), depth, probes.size());
+    printf("elapsed: %lld ms\n", elapsed);
+    printf("server list requests sent: %lld (%.1f/s), reply bytes received: %lld, attacker reconnects: %d\n",
+           requestsSent, requestsSent * 1000.0 / elapsed, bytesReceived, reconnects);
+
+    // pings that never got a reply are the worst latency of all
+    int unanswered = 0;
+    foreach (const Probe &probe, probes) {
+        if (probe.sentAt >= 0) {
+            unanswered ++;
+        }
+    }
+
+    if (latencies.isEmpty()) {
+        printf("ping latency: no replies, %d unanswered\n", unanswered);
+    } else {
+        qSort(latencies);
+        printf("ping latency: p50 %lld us, p90 %lld us, p99 %lld us, p99.9 %lld us, max %lld us, %d replies, %d unanswered\n",
+               latencies[latencies.size() * 50 / 100],
+               latencies[latencies.size() * 90 / 100],
+               latencies[latencies.size() * 99 / 100],
+               latencies[latencies.size() * 999 / 1000],
+               latencies.last(),
+               latencies.size(),
+               unanswered);
+    }
+
+    QCoreApplication::quit();
+}
@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef PIPELINEBENCH_H
+#define PIPELINEBENCH_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+class QTcpSocket;
+class QTimer;
+
+// Measures how long well-behaved clients wait for ping replies while other clients pipeline
+// server list requests at the planet as fast as it takes them.
+//
+// Attackers keep writing batches of ?G requests whenever their previous batch has been sent.
+// Probes send a ?K every now and then, one at a time, and time the K reply. Penalties have to be
+// off on the planet, otherwise attackers just get disconnected. Running it against a planet with
+// commandsPerTurn=0 and with the default shows what the per-connection command budget buys.
+class PipelineBench : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PipelineBench(QObject *parent = 0);
+
+    void start(const QString &address, quint16 port, int attackers, int depth, int probes, int seconds);
+
+private:
+    struct Probe {
+        // when the outstanding ping was sent, -1 if there is none
+        qint64 sentAt;
+        bool versionReceived;
+    };
+
+    QString address;
+    quint16 port;
+    int depth;
+    QByteArray batch;
+
+    QElapsedTimer time;
+    QTimer *pingTimer;
+    QTimer *stopTimer;
+    QList<QTcpSocket*> attackers;
+    QHash<QTcpSocket*, Probe> probes;
+    // in microseconds
+    QList<qint64> latencies;
+    qint64 requestsSent;
+    qint64 bytesReceived;
+    int reconnects;
+
+    QTcpSocket *connectSocket(const char *slot);
+    void sendBatch(QTcpSocket *socket);
+
+private slots:
+    void onAttackerConnected();
+    void onAttackerBytesWritten();
+    void onAttackerReadyRead();
+    void onAttackerDisconnected();
+    void onProbeReadyRead();
+    void onPing();
+    void onStop();
+
+};
+
+#endif // PIPELINEBENCH_H
@@ -0,0 +1,354 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "replayer.h"
+#include "../../src/trace.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QFile>
+#include <QHostAddress>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+Replayer::Replayer(QObject *parent) : QObject(parent), nextRecord(0), port(0), asFastAsPossible(false), bytesSent(0), bytesReceived(0), commandsSent(0)
+{
+    replayTimer = new QTimer(this);
+    replayTimer->setSingleShot(true);
+    connect(replayTimer, SIGNAL(timeout()), this, SLOT(onReplayTimer()));
+
+    idleTimer = new QTimer(this);
+    idleTimer->setSingleShot(true);
+    idleTimer->setInterval(IDLE_TIMEOUT);
+    connect(idleTimer, SIGNAL(timeout()), this, SLOT(onIdle()));
+
+    drainTimer = new QTimer(this);
+    drainTimer->setInterval(DRAIN_TIMEOUT / 4);
+    connect(drainTimer, SIGNAL(timeout()), this, SLOT(onDrain()));
+}
+
+bool Replayer::load(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical("Failed to open %s. %s.", qPrintable(filePath), qPrintable(file.errorString()));
+        return false;
+    }
+
+    QByteArray trace = file.readAll();
+    const uchar *data = reinterpret_cast<const uchar*>(trace.constData());
+    int size = trace.size();
+    int offset = 0;
+
+    // connection ids and times start over with every capture session in the file,
+    // so shift them to keep the sessions apart and in order
+    quint32 idBase = 0;
+    quint32 maxId = 0;
+    qint64 timeBase = 0;
+    qint64 maxTime = 0;
+
+    while (offset < size) {
+        if (size - offset >= Trace::MAGIC_LENGTH && memcmp(data + offset, Trace::MAGIC, Trace::MAGIC_LENGTH) == 0) {
+            offset += Trace::MAGIC_LENGTH;
+            idBase = maxId;
+            timeBase = maxTime;
+            continue;
+        }
+
+        if (size - offset < Trace::RECORD_HEADER_SIZE) {
+            qWarning("Trace %s is truncated, ignoring the last %d bytes.", qPrintable(filePath), size - offset);
+            break;
+        }
+
+        Trace::RecordHeader header;
+        Trace::readHeader(data + offset, header);
+        offset += Trace::RECORD_HEADER_SIZE;
+
+        if (size - offset < header.length) {
+            qWarning("Trace %s is truncated, ignoring the last record.", qPrintable(filePath));
+            break;
+        }
+
+        Record record;
+        record.type = header.type;
+        record.connectionId = idBase + header.connectionId;
+        record.time = timeBase + header.time;
+        record.data = QByteArray(trace.constData() + offset, header.length);
+        offset += header.length;
+
+        maxId = qMax(maxId, record.connectionId);
+        maxTime = qMax(maxTime, record.time);
+
+        records << record;
+    }
+
+    qDebug("Loaded %d records from %s.", records.size(), qPrintable(filePath));
+
+    return true;
+}
+
+void Replayer::start(const QString &address, quint16 port, bool asFastAsPossible)
+{
+    this->address = address;
+    this->port = port;
+    this->asFastAsPossible = asFastAsPossible;
+
+    time.start();
+    replayTimer->start(0);
+    drainTimer->start();
+}
+
+void Replayer::play(const Record &record)
+{
+    switch (record.type) {
+        case Trace::Accept: {
+            Connection connection;
+            connection.socket = new QTcpSocket(this);
+            connection.awaitingSince = 0;
+            connection.closing = false;
+            connection.lastActivity = time.elapsed();
+            connect(connection.socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+            connect(connection.socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+            connection.socket->connectToHost(QHostAddress(address), port);
+
+            connections.insert(record.connectionId, connection);
+            connectionIds.insert(connection.socket, record.connectionId);
+            break;
+        }
+        case Trace::Data: {
+            QHash<quint32, Connection>::iterator it = connections.find(record.connectionId);
+            if (it == connections.end()) {
+                break;
+            }
+
+            // the socket buffers the data until it's connected
+            it.value().socket->write(record.data);
+            if (it.value().awaitingSince == 0) {
+                it.value().awaitingSince = time.elapsed() + 1;
+            }
+            it.value().lastActivity = time.elapsed();
+
+            bytesSent += record.data.size();
+            commandsSent ++;
+            break;
+        }
+        case Trace::Disconnect: {
+            QHash<quint32, Connection>::iterator it = connections.find(record.connectionId);
+            if (it == connections.end()) {
+                break;
+            }
+
+            // replies to the last commands may still be on their way, especially with --fast,
+            // so the connection is closed only once they have stopped coming
+            it.value().closing = true;
+            it.value().lastActivity = time.elapsed();
+            break;
+        }
+        default:
+            qWarning("Unknown record type %d, skipping.", record.type);
+            break;
+    }
+}
+
+void Replayer::onReplayTimer()
+{
+    qint64 now = time.elapsed();
+
+    while (nextRecord < records.size()) {
+        const Record &record = records[nextRecord];
+
+        if (!asFastAsPossible && record.time > now) {
+            replayTimer->start(record.time - now);
+            return;
+        }
+
+        play(record);
+        nextRecord ++;
+
+        // let the replies get processed once in a while when going as fast as possible
+        if (asFastAsPossible && nextRecord % 256 == 0) {
+            replayTimer->start(0);
+            return;
+        }
+    }
+
+    idleTimer->start();
+}
+
+void Replayer::onReadyRead()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+    QHash<QTcpSocket*, quint32>::const_iterator idIt = connectionIds.constFind(socket);
+    if (idIt == connectionIds.constEnd()) {
+        return;
+    }
+
+    Connection &connection = connections[idIt.value()];
+
+    QByteArray data = socket->readAll();
+    connection.received.append(data);
+    bytesReceived += data.size();
+    connection.lastActivity = time.elapsed();
+
+    if (connection.awaitingSince != 0) {
+        latencies << time.elapsed() + 1 - connection.awaitingSince;
+        connection.awaitingSince = 0;
+    }
+
+    if (nextRecord == records.size()) {
+        idleTimer->start();
+    }
+}
+
+void Replayer::finishConnection(quint32 id)
+{
+    Connection connection = connections.take(id);
+    connectionIds.remove(connection.socket);
+
+    QByteArray data = connection.socket->readAll();
+    connection.received.append(data);
+    bytesReceived += data.size();
+    finished.insert(id, connection.received);
+
+    connection.socket->disconnect(this);
+    connection.socket->disconnectFromHost();
+    connection.socket->deleteLater();
+}
+
+void Replayer::onDrain()
+{
+    qint64 now = time.elapsed();
+
+    QList<quint32> drained;
+    for (QHash<quint32, Connection>::const_iterator it = connections.constBegin(); it != connections.constEnd(); ++ it) {
+        const Connection &connection = it.value();
+        if (connection.closing && connection.socket->bytesToWrite() == 0 && now - connection.lastActivity >= DRAIN_TIMEOUT) {
+            drained << it.key();
+        }
+    }
+    foreach (quint32 id, drained) {
+        finishConnection(id);
+    }
+}
+
+void Replayer::onDisconnected()
+{
+    // the planet has closed the connection, so there is nothing more to wait for
+    QHash<QTcpSocket*, quint32>::const_iterator idIt = connectionIds.constFind(qobject_cast<QTcpSocket*>(sender()));
+    if (idIt != connectionIds.constEnd()) {
+        finishConnection(idIt.value());
+    }
+}
+
+void Replayer::onIdle()
+{
+    qint64 elapsed = time.elapsed() - IDLE_TIMEOUT;
+
+    QMap<quint32, QByteArray> output = finished;
+    for (QHash<quint32, Connection>::const_iterator it = connections.constBegin(); it != connections.constEnd(); ++ it) {
+        output.insert(it.key(), it.value().received);
+    }
+
+    report(qMax(elapsed, qint64(1)));
+
+    if (!outputFilePath.isEmpty()) {
+        saveOutput(output);
+    }
+    int differences = 0;
+    if (!compareFilePath.isEmpty()) {
+        differences = compareOutput(output);
+    }
+
+    // nonzero when the replies don't match, so that a script can tell
+    QCoreApplication::exit(differences == 0 ? 0 : 1);
+}
+
+void Replayer::report(qint64 elapsed)
+{
+    printf("records: %d\n", records.size());
+    printf("connections: %d\n", finished.size() + connections.size());
+    printf("commands sent: %d\n", commandsSent);
+    printf("bytes sent: %lld, received: %lld\n", bytesSent, bytesReceived);
+    printf("elapsed: %lld ms\n", elapsed);
+    printf("throughput: %.1f commands/s, %.1f KiB/s sent, %.1f KiB/s received\n", commandsSent * 1000.0 / elapsed, bytesSent / 1.024 / elapsed, bytesReceived / 1.024 / elapsed);
+
+    if (latencies.isEmpty()) {
+        printf("latency: no replies\n");
+        return;
+    }
+
+    qSort(latencies);
+    printf("latency: p50 %lld ms, p90 %lld ms, p99 %lld ms, max %lld ms\n",
+           latencies[latencies.size() * 50 / 100],
+           latencies[latencies.size() * 90 / 100],
+           latencies[latencies.size() * 99 / 100],
+           latencies.last());
+}
+
+bool Replayer::saveOutput(const QMap<quint32, QByteArray> &output)
+{
+    QFile file(outputFilePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCritical("Failed to open %s for writing. %s.", qPrintable(outputFilePath), qPrintable(file.errorString()));
+        return false;
+    }
+
+    QDataStream out(&file);
+    out << output;
+
+    return true;
+}
+
+int Replayer::compareOutput(const QMap<quint32, QByteArray> &output)
+{
+    QFile file(compareFilePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCritical("Failed to open %s. %s.", qPrintable(compareFilePath), qPrintable(file.errorString()));
+        return -1;
+    }
+
+    QMap<quint32, QByteArray> reference;
+    QDataStream in(&file);
+    in >> reference;
+
+    int differences = 0;
+
+    QList<quint32> ids = output.keys() + reference.keys();
+    qSort(ids);
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+    foreach (quint32 id, ids) {
+        if (output.value(id) != reference.value(id)) {
+            printf("connection %u: output differs (%d bytes now, %d bytes in %s)\n", id, output.value(id).size(), reference.value(id).size(), qPrintable(compareFilePath));
+            differences ++;
+        }
+    }
+
+    printf("%d of %d connections have different output\n", differences, ids.size());
+
+    return differences;
+}
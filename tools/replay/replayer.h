@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef REPLAYER_H
+#define REPLAYER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QString>
+
+class QTcpSocket;
+class QTimer;
+
+// Plays a traffic capture made by the planet against a running planet over TCP
+// and reports throughput, reply latency and, optionally, how the replies differ from a previous run.
+class Replayer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Replayer(QObject *parent = 0);
+
+    bool load(const QString &filePath);
+    void start(const QString &address, quint16 port, bool asFastAsPossible);
+
+    // replies received on every connection, keyed by connection id of the capture
+    void setOutputFile(const QString &filePath) {outputFilePath = filePath;}
+    void setCompareFile(const QString &filePath) {compareFilePath = filePath;}
+
+private:
+    struct Record {
+        quint8 type;
+        quint32 connectionId;
+        qint64 time;
+        QByteArray data;
+    };
+
+    struct Connection {
+        QTcpSocket *socket;
+        QByteArray received;
+        // time the oldest unanswered data was sent, 0 if there is none
+        qint64 awaitingSince;
+        // the capture has closed the connection, it's kept open until the replies stop coming
+        bool closing;
+        // last time data was sent or received
+        qint64 lastActivity;
+    };
+
+    QList<Record> records;
+    int nextRecord;
+
+    QString address;
+    quint16 port;
+    bool asFastAsPossible;
+
+    QHash<quint32, Connection> connections;
+    QHash<QTcpSocket*, quint32> connectionIds;
+    // replies of connections that are already gone
+    QMap<quint32, QByteArray> finished;
+
+    QElapsedTimer time;
+    QTimer *replayTimer;
+    QTimer *idleTimer;
+    QTimer *drainTimer;
+
+    qint64 bytesSent;
+    qint64 bytesReceived;
+    int commandsSent;
+    QList<qint64> latencies;
+
+    QString outputFilePath;
+    QString compareFilePath;
+
+    // how long to wait for the replies after the last record has been played
+    static const int IDLE_TIMEOUT = 2000;
+    // how long a closed connection has to stay quiet before its replies are considered complete
+    static const int DRAIN_TIMEOUT = 200;
+
+    void play(const Record &record);
+    void report(qint64 elapsed);
+    bool saveOutput(const QMap<quint32, QByteArray> &output);
+    // returns the number of connections with different replies, -1 if there was nothing to compare with
+    int compareOutput(const QMap<quint32, QByteArray> &output);
+    void finishConnection(quint32 id);
+
+private slots:
+    void onReplayTimer();
+    void onReadyRead();
+    void onIdle();
+    void onDrain();
+    void onDisconnected();
+
+};
+
+#endif // REPLAYER_H
@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "fakeconnection.h"
+
+quint64 FakeConnection::totalReplies = 0;
+quint64 FakeConnection::totalReplyBytes = 0;
+quint64 FakeConnection::replyChecksum = Q_UINT64_C(0xCBF29CE484222325);
+
+FakeConnection::FakeConnection(const QHostAddress &address, quint16 port) : address(address), port(port), inputPosition(0), open(true), slow(false), pendingOutput(0)
+{
+    // intentially left blank
+}
+
+void FakeConnection::send(const char *line)
+{
+    if (!open) {
+        return;
+    }
+
+    input.append(line);
+    emit readyRead();
+
+    // the planet reads everything it's given, but it might have stopped early, e.g. on penalty
+    if (inputPosition == input.size()) {
+        input.clear();
+        inputPosition = 0;
+    }
+}
+
+qint64 FakeConnection::readLine(char *data, qint64 maxSize)
+{
+    // same as QIODevice::readLine(): up to and including a new line, at most maxSize - 1 bytes, null terminated
+    qint64 length = 0;
+    while (length < maxSize - 1 && inputPosition < input.size()) {
+        char c = input[inputPosition ++];
+        data[length ++] = c;
+        if (c == '\n') {
+            break;
+        }
+    }
+    data[length] = '\0';
+    return length;
+}
+
+qint64 FakeConnection::write(const char *data, qint64 size)
+{
+    if (!open) {
+        return -1;
+    }
+
+    totalReplies ++;
+    totalReplyBytes += size;
+    for (qint64 i = 0; i < size; i ++) {
+        replyChecksum = (replyChecksum ^ quint8(data[i])) * Q_UINT64_C(0x100000001B3);
+    }
+    if (slow) {
+        pendingOutput += size;
+    }
+    return size;
+}
+
+void FakeConnection::disconnectFromHost()
+{
+    if (open) {
+        open = false;
+        emit disconnected();
+    }
+}
+
+void FakeConnection::abort()
+{
+    disconnectFromHost();
+}
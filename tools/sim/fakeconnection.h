@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FAKECONNECTION_H
+#define FAKECONNECTION_H
+
+#include "../../src/transport.h"
+
+// In-memory connection between a simulated client and the planet.
+//
+// Whatever the client sends is handed to the planet right away. Replies are only counted and
+// checksummed, and are considered read by the client as soon as they are written, unless the client is slow.
+class FakeConnection : public Transport
+{
+    Q_OBJECT
+public:
+    FakeConnection(const QHostAddress &address, quint16 port);
+
+    // as if the client wrote a line, \r\n included
+    void send(const char *line);
+
+    bool isOpen() const {return open;}
+    // a slow client doesn't read its replies, they pile up in bytesToWrite()
+    void setSlow(bool slow) {this->slow = slow;}
+
+    // replies written to all connections so far, connections get deleted by the planet when closed
+    static quint64 getTotalReplies() {return totalReplies;}
+    static quint64 getTotalReplyBytes() {return totalReplyBytes;}
+    // FNV-1a of all replies in the order they were written
+    static quint64 getReplyChecksum() {return replyChecksum;}
+
+    QHostAddress peerAddress() const {return address;}
+    quint16 peerPort() const {return port;}
+
+    qint64 bytesAvailable() const {return input.size() - inputPosition;}
+    qint64 readLine(char *data, qint64 maxSize);
+    qint64 write(const char *data, qint64 size);
+    using Transport::write;
+    qint64 bytesToWrite() const {return pendingOutput;}
+
+    void disconnectFromHost();
+    void abort();
+    QString errorString() const {return QString();}
+
+private:
+    QHostAddress address;
+    quint16 port;
+    QByteArray input;
+    int inputPosition;
+    bool open;
+    bool slow;
+    qint64 pendingOutput;
+
+    static quint64 totalReplies;
+    static quint64 totalReplyBytes;
+    static quint64 replyChecksum;
+
+};
+
+#endif // FAKECONNECTION_H
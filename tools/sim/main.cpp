@@ -0,0 +1,199 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "simulation.h"
+#include "../../src/settings.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QSettings>
+#include <QStringList>
+
+#include <cstdio>
+
+static bool verbose = false;
+
+#if QT_VERSION >= 0x050000
+static void messageHandler(QtMsgType type, const QMessageLogContext &, const QString &message)
+{
+    if (verbose || type != QtDebugMsg) {
+        fprintf(stderr, "%s\n", qPrintable(message));
+    }
+}
+#else
+static void messageHandler(QtMsgType type, const char *message)
+{
+    if (verbose || type != QtDebugMsg) {
+        fprintf(stderr, "%s\n", message);
+    }
+}
+#endif
+
+static void printUsage(const char *name)
+{
+    printf("Usage: %s [options]\n"
+           "Runs qt-nfk-planet in virtual time against simulated clients and reports\n"
+           "how much CPU time it takes per simulated second.\n\n"
+           "  --scenario <name>     steady, flood, reconnect-storm or ping-timeout, steady by default\n"
+           "  --clients <n>         number of simulated clients, 10000 by default\n"
+           "  --seconds <n>         simulated time, 300 by default\n"
+           "  --seed <n>            seed of the client behaviour, runs with the same seed are identical\n"
+           "  --settings <file>     planet settings to use instead of the generated ones\n"
+           "  --no-timing           leave CPU times out of the report, so that reports can be compared\n"
+           "  --check-determinism   run the simulation twice without timing and exit with 3 if the\n"
+           "                        reports or the exit codes differ\n"
+           "  --verbose             show planet's debug messages too\n", name);
+}
+
+static int runChild(const QString &program, const QStringList &arguments, QByteArray &report)
+{
+    QProcess process;
+    process.start(program, arguments);
+    if (!process.waitForFinished(-1) || process.exitStatus() != QProcess::NormalExit) {
+        printf("FAILED: %s didn't run to the end: %s.\n", qPrintable(program), qPrintable(process.errorString()));
+        return -1;
+    }
+    report = process.readAllStandardOutput();
+    return process.exitCode();
+}
+
+static int checkDeterminism(const QString &program, const QStringList &arguments)
+{
+    QByteArray reports[2];
+    int exitCodes[2];
+
+    for (int i = 0; i < 2; i ++) {
+        exitCodes[i] = runChild(program, arguments, reports[i]);
+        if (exitCodes[i] == -1) {
+            return 3;
+        }
+    }
+
+    fwrite(reports[0].constData(), 1, reports[0].size(), stdout);
+
+    if (exitCodes[0] != exitCodes[1]) {
+        printf("FAILED: the runs exited with %d and %d.\n", exitCodes[0], exitCodes[1]);
+        return 3;
+    }
+
+    if (reports[0] != reports[1]) {
+        QList<QByteArray> first = reports[0].split('\n');
+        QList<QByteArray> second = reports[1].split('\n');
+        for (int i = 0; i < qMax(first.size(), second.size()); i ++) {
+            QByteArray a = i < first.size() ? first[i] : QByteArray();
+            QByteArray b = i < second.size() ? second[i] : QByteArray();
+            if (a != b) {
+                printf("FAILED: the reports differ at line %d:\n  %s\n  %s\n", i + 1, a.constData(), b.constData());
+                break;
+            }
+        }
+        return 3;
+    }
+
+    printf("Determinism check passed, both runs gave the same report.\n");
+    return exitCodes[0];
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList args = a.arguments();
+
+    Simulation::Scenario scenario = Simulation::Steady;
+    int clients = 10000;
+    int seconds = 300;
+    quint32 seed = 1;
+    QString settingsFile;
+    bool timing = true;
+    bool check = false;
+
+    for (int i = 1; i < args.size(); i ++) {
+        bool ok = true;
+        if (args[i] == "--check-determinism") {
+            check = true;
+        } else if (args[i] == "--verbose") {
+            verbose = true;
+        } else if (args[i] == "--no-timing") {
+            timing = false;
+        } else if (i + 1 < args.size() && args[i] == "--scenario") {
+            ok = Simulation::parseScenario(args[++ i], scenario);
+        } else if (i + 1 < args.size() && args[i] == "--clients") {
+            clients = args[++ i].toInt(&ok);
+            ok = ok && clients > 0;
+        } else if (i + 1 < args.size() && args[i] == "--seconds") {
+            seconds = args[++ i].toInt(&ok);
+            ok = ok && seconds > 0;
+        } else if (i + 1 < args.size() && args[i] == "--seed") {
+            seed = args[++ i].toUInt(&ok);
+        } else if (i + 1 < args.size() && args[i] == "--settings") {
+            settingsFile = args[++ i];
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (check) {
+        QStringList childArgs = args.mid(1);
+        childArgs.removeAll("--check-determinism");
+        childArgs << "--no-timing";
+        return checkDeterminism(a.applicationFilePath(), childArgs);
+    }
+
+#if QT_VERSION >= 0x050000
+    qInstallMessageHandler(messageHandler);
+#else
+    qInstallMsgHandler(messageHandler);
+#endif
+
+    if (settingsFile.isEmpty()) {
+        // defaults, except for what would get in the way of a simulation
+        settingsFile = QDir::temp().filePath("qt-nfk-sim.ini");
+        QFile::remove(settingsFile);
+        QSettings s(settingsFile, QSettings::IniFormat);
+        s.setValue("Network/maxClients", clients + 1);
+        // every client has its own address anyway
+        s.setValue("Network/maxSimultaneousConnectionsFromSingleIp", -1);
+        // blacklisting rewrites the settings file every time
+        s.setValue("Penalty/blacklistIpOnMaxPenaltyPointsReached", false);
+        s.setValue("AbuseDetector/blacklistHotIps", false);
+        s.setValue("Admin/enable", false);
+        s.setValue("History/enable", false);
+        // both are driven by wall clock timers, which the simulation never runs
+        s.setValue("LoadMonitor/enable", false);
+        s.setValue("Prober/enable", false);
+        s.sync();
+    }
+    Settings::getInstance(settingsFile);
+
+    Simulation simulation(scenario, clients, seconds, seed);
+    simulation.setTiming(timing);
+    return simulation.run() ? 0 : 2;
+}
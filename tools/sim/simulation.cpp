@@ -0,0 +1,318 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "fakeconnection.h"
+#include "simulation.h"
+#include "../../src/planet.h"
+
+#include <QCoreApplication>
+#include <QHostAddress>
+#include <QMetaObject>
+
+#include <cstdio>
+#include <ctime>
+
+bool Simulation::parseScenario(const QString &name, Scenario &scenario)
+{
+    if (name == "steady") {
+        scenario = Steady;
+    } else if (name == "flood") {
+        scenario = Flood;
+    } else if (name == "reconnect-storm") {
+        scenario = ReconnectStorm;
+    } else if (name == "ping-timeout") {
+        scenario = PingTimeout;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+Simulation::Simulation(Scenario scenario, int clientCount, int seconds, quint32 seed) :
+    scenario(scenario), clientCount(clientCount), seconds(seconds), randomState(seed == 0 ? 1 : seed), timing(true),
+    connects(0), rejectedConnects(0), commands(0), droppedByPlanet(0)
+{
+    // start at a believable time, some code treats 0 as "never"
+    clock.now = Q_INT64_C(1400000000000);
+    Clock::set(&clock);
+
+    planet = new Planet();
+
+    clients.resize(clientCount);
+    for (int i = 0; i < clientCount; i ++) {
+        VirtualClient &client = clients[i];
+        // every client gets its own address, 10.0.0.1 and up
+        client.address = (10u << 24) + 1 + i;
+        client.step = 0;
+
+        if (scenario == Flood && i % 100 == 0) {
+            client.role = Flooder;
+        } else if ((scenario == Steady || scenario == Flood) && i % 10 == 1) {
+            client.role = GameServer;
+        } else {
+            client.role = Player;
+        }
+
+        // everybody shows up within the first 10 seconds
+        schedule.insert(clock.now + randomBetween(0, 10*1000), i);
+    }
+}
+
+Simulation::~Simulation()
+{
+    delete planet;
+    Clock::set(NULL);
+}
+
+quint32 Simulation::nextRandom()
+{
+    // xorshift32, the same sequence on every platform
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+int Simulation::randomBetween(int from, int to)
+{
+    return from + int(nextRandom() % quint32(to - from + 1));
+}
+
+bool Simulation::connectClient(int index)
+{
+    VirtualClient &client = clients[index];
+    QHostAddress address(client.address);
+
+    connects ++;
+    if (!planet->admitConnection(address)) {
+        rejectedConnects ++;
+        return false;
+    }
+
+    client.connection = new FakeConnection(address, 1024 + index % 60000);
+    client.step = 0;
+    planet->addConnection(client.connection);
+    return true;
+}
+
+void Simulation::send(int index, const char *line)
+{
+    VirtualClient &client = clients[index];
+    if (client.connection != NULL && client.connection->isOpen()) {
+        commands ++;
+        client.connection->send(line);
+    }
+}
+
+void Simulation::disconnectClient(int index)
+{
+    VirtualClient &client = clients[index];
+    if (client.connection != NULL) {
+        client.connection->disconnectFromHost();
+        client.connection = NULL;
+    }
+}
+
+int Simulation::countOpenConnections()
+{
+    int count = 0;
+    for (int i = 0; i < clients.size(); i ++) {
+        if (clients[i].connection != NULL && clients[i].connection->isOpen()) {
+            count ++;
+        }
+    }
+    return count;
+}
+
+void Simulation::act(int index)
+{
+    VirtualClient &client = clients[index];
+    qint64 now = clock.now;
+
+    if (client.connection != NULL && !client.connection->isOpen()) {
+        // the planet has dropped us
+        droppedByPlanet ++;
+        client.connection = NULL;
+        if (scenario != PingTimeout) {
+            schedule.insert(now + (client.role == Flooder ? 1000 : 5000), index);
+        }
+        return;
+    }
+
+    if (client.connection == NULL) {
+        if (!connectClient(index)) {
+            schedule.insert(now + 5000, index);
+            return;
+        }
+    }
+
+    char line[64];
+    int step = client.step ++;
+
+    if (step == 0) {
+        send(index, "?V077\r\n");
+        if (client.role == GameServer) {
+            qsnprintf(line, sizeof(line), "?R%d\r\n", 27960 + index % 1000);
+            send(index, line);
+            qsnprintf(line, sizeof(line), "?Nsimulated server %d\r\n", index);
+            send(index, line);
+            send(index, index % 3 == 0 ? "?mdm1\r\n" : "?mtourney4\r\n");
+            send(index, "?M8\r\n");
+        } else if (scenario != PingTimeout) {
+            send(index, "?G\r\n");
+        }
+    }
+
+    switch (scenario) {
+        case PingTimeout:
+            // never heard from again
+            return;
+        case ReconnectStorm:
+            if (step == 1) {
+                disconnectClient(index);
+                schedule.insert(now + randomBetween(0, 1000), index);
+            } else {
+                schedule.insert(now + randomBetween(1000, 5000), index);
+            }
+            return;
+        case Steady:
+        case Flood:
+            break;
+    }
+
+    switch (client.role) {
+        case Flooder:
+            if (step != 0) {
+                send(index, "?S\r\n");
+            }
+            schedule.insert(now + 50, index);
+            break;
+        case GameServer:
+            if (step != 0) {
+                qsnprintf(line, sizeof(line), "?C%d\r\n", randomBetween(0, 8));
+                send(index, line);
+                send(index, "?K\r\n");
+            }
+            schedule.insert(now + 30*1000, index);
+            break;
+        case Player:
+            if (step != 0) {
+                send(index, "?K\r\n");
+                // players look at the server list every now and then
+                if (step % 5 == 0) {
+                    send(index, "?G\r\n");
+                }
+            }
+            schedule.insert(now + 60*1000, index);
+            break;
+    }
+}
+
+bool Simulation::run()
+{
+    qint64 start = clock.now;
+    qint64 end = start + qint64(seconds) * 1000;
+    qint64 nextPingCheck = start + PING_CHECK_PERIOD;
+    qint64 nextReport = start + REPORT_PERIOD;
+
+    std::clock_t cpuStart = std::clock();
+    std::clock_t cpuReport = cpuStart;
+
+    while (clock.now < end) {
+        // the earliest of the next client action, ping check and report
+        qint64 next = qMin(qMin(nextPingCheck, nextReport), end);
+        if (!schedule.isEmpty() && schedule.constBegin().key() < next) {
+            next = schedule.constBegin().key();
+        }
+        clock.now = next;
+
+        while (!schedule.isEmpty() && schedule.constBegin().key() <= clock.now) {
+            int index = schedule.constBegin().value();
+            schedule.erase(schedule.begin());
+            act(index);
+        }
+
+        // one round of turns of clients with more input than their command budget, which is what the
+        // planet's ready queue timer would run, without letting any other timer fire
+        QMetaObject::invokeMethod(planet, "onReadyQueue");
+
+        if (clock.now >= nextPingCheck) {
+            QMetaObject::invokeMethod(planet, "onPingCheck");
+            nextPingCheck += PING_CHECK_PERIOD;
+            // the planet deletes connections of disconnected clients later
+            QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+        }
+
+        if (clock.now >= nextReport) {
+            std::clock_t cpuNow = std::clock();
+            double cpuMilliseconds = 1000.0 * (cpuNow - cpuReport) / CLOCKS_PER_SEC;
+            printf("t=%llds connections=%d servers=%d", (clock.now - start) / 1000, countOpenConnections(), planet->getServers().size());
+            if (timing) {
+                printf(" cpu=%.2f ms per simulated second", cpuMilliseconds / (REPORT_PERIOD / 1000));
+            }
+            printf("\n");
+            fflush(stdout);
+            cpuReport = cpuNow;
+            nextReport += REPORT_PERIOD;
+        }
+    }
+
+    double cpuSeconds = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    int open = countOpenConnections();
+
+    if (timing) {
+        printf("Simulated %d seconds with %d clients in %.2f s of CPU time, %.2f ms per simulated second.\n",
+               seconds, clientCount, cpuSeconds, 1000.0 * cpuSeconds / seconds);
+    } else {
+        printf("Simulated %d seconds with %d clients.\n", seconds, clientCount);
+    }
+    printf("Connects: %llu, rejected: %llu, dropped by the planet: %llu, still connected: %d, servers listed: %d.\n",
+           connects, rejectedConnects, droppedByPlanet, open, planet->getServers().size());
+    printf("Commands sent: %llu, replies: %llu (%llu bytes, checksum %016llx).\n",
+           commands, FakeConnection::getTotalReplies(), FakeConnection::getTotalReplyBytes(), FakeConnection::getReplyChecksum());
+
+    switch (scenario) {
+        case PingTimeout:
+            if (open != 0) {
+                printf("FAILED: %d clients outlived the ping timeout.\n", open);
+                return false;
+            }
+            break;
+        case Flood:
+            if (droppedByPlanet == 0) {
+                printf("FAILED: no flooder got dropped.\n");
+                return false;
+            }
+            break;
+        case Steady:
+            if (droppedByPlanet != 0) {
+                printf("FAILED: %llu well-behaved clients got dropped.\n", droppedByPlanet);
+                return false;
+            }
+            break;
+        case ReconnectStorm:
+            break;
+    }
+
+    return true;
+}
@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) 2014 Maxim Biro <nurupo.contributions@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "../../src/clock.h"
+
+#include <QMultiMap>
+#include <QPointer>
+#include <QVector>
+
+class FakeConnection;
+class Planet;
+
+class SimulatedClock : public Clock
+{
+public:
+    SimulatedClock() : now(0) {}
+
+    qint64 currentMSecsSinceEpoch() {return now;}
+
+    qint64 now;
+
+};
+
+// Runs a planet in virtual time against scripted clients that talk to it over fake connections.
+//
+// Nothing touches the network and time only moves when the simulation moves it, so a run with the
+// same arguments does the same thing every time, however fast or slow the machine is. The event
+// loop is never run, so no wall clock timer of the planet can fire either. What is measured is the
+// CPU time the planet spends per simulated second.
+class Simulation
+{
+public:
+    enum Scenario {
+        // players ping and ask for the server list, game servers update their state
+        Steady,
+        // steady, with a few clients sending commands as fast as they can and reconnecting when dropped
+        Flood,
+        // clients keep disconnecting and connecting again after a few seconds
+        ReconnectStorm,
+        // clients say hello and then go silent, all of them must be dropped for ping timeout
+        PingTimeout
+    };
+
+    static bool parseScenario(const QString &name, Scenario &scenario);
+
+    // the planet must be created after the simulated clock is installed
+    Simulation(Scenario scenario, int clientCount, int seconds, quint32 seed);
+    ~Simulation();
+
+    // without timing the output is the same on every run with the same arguments
+    void setTiming(bool timing) {this->timing = timing;}
+
+    // returns false if the scenario didn't end the way it should have
+    bool run();
+
+private:
+    enum Role {
+        Player,
+        GameServer,
+        Flooder
+    };
+
+    struct VirtualClient {
+        QPointer<FakeConnection> connection;
+        quint32 address;
+        Role role;
+        // actions taken since connecting
+        int step;
+    };
+
+    Scenario scenario;
+    int clientCount;
+    int seconds;
+    quint32 randomState;
+    bool timing;
+
+    SimulatedClock clock;
+    Planet *planet;
+
+    QVector<VirtualClient> clients;
+    // virtual time of the next action of each client, by client index
+    QMultiMap<qint64, int> schedule;
+
+    quint64 connects;
+    quint64 rejectedConnects;
+    quint64 commands;
+    quint64 droppedByPlanet;
+
+    // planet's ping check period, as in Planet::CHECK_PING_TIMEOUT
+    static const int PING_CHECK_PERIOD = 10*1000;
+    static const int REPORT_PERIOD = 60*1000;
+
+    quint32 nextRandom();
+    int randomBetween(int from, int to);
+
+    void act(int index);
+    bool connectClient(int index);
+    void send(int index, const char *line);
+    void disconnectClient(int index);
+    int countOpenConnections();
+
+};
+
+#endif // SIMULATION_H